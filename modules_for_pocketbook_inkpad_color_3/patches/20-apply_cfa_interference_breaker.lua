@@ -4,11 +4,53 @@ require("ffi/inkview_h")
 local logger = require("logger")
 local framebuffer = require("ffi/framebuffer_pocketbook")
 local Device = require("device")
+local UIManager = require("ui/uimanager")
 local PowerD = Device.powerd
 
 -- Paramétrage BREAK RAINBOW
 local param_radius_min = 9999
-local param_radius_max_diviser = 2.4
+local param_radius_max_diviser = 2.4
+-- Bourrage de l'image jusqu'à une taille rapide pour la FFT (0 : aucun, 1 : miroir, 2 : bord répété, 3 : zéros)
+local param_padding = 1
+-- Mode économe en mémoire : un seul buffer FFT par taille de transformée
+local param_lean_mode = true
+-- Pages mixtes : le moiré est supprimé dans les zones noir et blanc, les couleurs ajustées ailleurs
+local param_color_tiles = true
+-- Côté des tuiles (pixels) utilisées pour séparer les zones colorées des zones noir et blanc
+local param_tile_size = 64
+-- Mode incrémental : seules les tuiles modifiées depuis la dernière image filtrée sont refiltrées
+-- (garde la dernière source et la dernière sortie en mémoire, 2 octets par pixel)
+local param_incremental = true
+-- Moteur de filtrage (0 : une transformée de tout l'écran, 1 : tuiles recouvrantes, plus économes
+-- en mémoire, 2 : convolution sans FFT, passe-bas pur uniquement) et côté des tuiles (puissance de 2 de 64 à 512)
+local param_engine = 0
+local param_engine_tile_size = 256
+-- Décimation du moteur 0 : l'écran est filtré à une résolution réduite de ce facteur, puis interpolé
+-- (1 : pleine résolution, 2 à 4 : 4 à 16 fois moins de points, plus rapide et plus économe, image plus douce ;
+-- avec param_radius_min = 9999 la coupure dépasse toutes les fréquences réduites et la FFT est sautée)
+local param_decimation = 1
+-- Qualité du filtrage des rafraîchissements rapides (défilement, déplacement, zoom) : 0 : pleine,
+-- 1 : résolution réduite de moitié (brouillon : réduction lissée puis agrandissement, sans FFT avec
+-- param_radius_min = 9999), 2 : aucun filtrage
+-- Les rafraîchissements partiels et complets suivants refiltrent ces zones en pleine qualité
+local param_fast_quality = 1
+-- Cache des pages filtrées (Mo, 0 : désactivé) : une page revue est recopiée sans nouveau filtrage
+-- (1 octet par pixel, environ 2 Mo par page sur l'Inkpad Color 3) ; vidé à la mise en veille
+local param_page_cache_mb = 16
+-- Seuil de la sonde d'énergie (niveaux de gris) en dessous duquel une page n'est pas filtrée, ses
+-- fréquences proches de la trame du CFA étant trop faibles pour produire l'effet arc-en-ciel
+-- (0 : toujours filtrer). Le score de chaque page est écrit dans le journal de débogage
+local param_skip_threshold = 0
+-- Filtrage asynchrone des rafraîchissements complets : la FFT se fait en arrière-plan et l'écran
+-- n'est rafraîchi qu'une fois l'image prête, l'interface restant réactive pendant ce temps
+-- (moteur écran complet, sans le mode incrémental ni la séparation des pages mixtes avant la détection)
+local param_async = false
+-- Intervalle entre deux vérifications de la fin du filtrage asynchrone (secondes)
+local param_async_poll = 0.02
+
+-- Sagesse FFTW (plans mesurés) conservée entre les sessions et les mises en veille
+-- Peut être pré-générée en FFTW_PATIENT sur la liseuse avec moire_wisdom_gen
+local wisdom_path = "custom_libs/moire_fftw_wisdom.dat"
 
 -- Chargement des bibliothèques partagées
 local moire = ffi.load("custom_libs/moire_filter_fftw_eco.so")
@@ -17,13 +59,33 @@ local color_detect = ffi.load("custom_libs/color_detect.so")
 local fft_initialized = false  -- Variable globale pour savoir si fft_module_init() a été appelée
 
 ffi.cdef[[
-    void remove_moire(unsigned char *fb_data, int width, int height, int line_length, float param_radius_min, float param_radius_max_diviser);
+    int remove_moire(unsigned char *fb_data, int width, int height, int line_length, float param_radius_min, float param_radius_max_diviser);
+]]
+
+ffi.cdef[[
+    int remove_moire_rect(unsigned char *fb_data, int width, int height, int line_length, int x, int y, int w, int h, float param_radius_min, float param_radius_max_diviser);
+]]
+
+ffi.cdef[[
+    int remove_moire_rect_quality(unsigned char *fb_data, int width, int height, int line_length, int x, int y, int w, int h, int quality, float param_radius_min, float param_radius_max_diviser);
 ]]
 
 ffi.cdef[[
     bool is_framebuffer_colored(uint8_t* data, int width, int height, int stride, int tolerance);
 ]]
 
+ffi.cdef[[
+    bool is_framebuffer_colored_mode(uint8_t* data, int width, int height, int stride, int tolerance, int mode);
+]]
+
+ffi.cdef[[
+    int framebuffer_color_tiles(uint8_t* data, int width, int height, int stride, int tolerance, int tile_size, uint8_t* tiles, int max_tiles);
+]]
+
+ffi.cdef[[
+    int remove_moire_masked(unsigned char *fb_data, int width, int height, int line_length, const unsigned char *tiles, int tile_size, float param_radius_min, float param_radius_max_diviser);
+]]
+
 ffi.cdef[[
     int init_moire_resources();
 ]]
@@ -32,6 +94,123 @@ ffi.cdef[[
     void cleanup_moire_resources();
 ]]
 
+ffi.cdef[[
+    void trim_moire_resources();
+]]
+
+ffi.cdef[[
+    int load_moire_wisdom(const char *path);
+]]
+
+ffi.cdef[[
+    int set_moire_padding(int pad_mode);
+]]
+
+ffi.cdef[[
+    void set_moire_lean_mode(int enabled);
+]]
+
+ffi.cdef[[
+    size_t get_moire_peak_bytes();
+]]
+
+ffi.cdef[[
+    int save_moire_wisdom();
+]]
+
+ffi.cdef[[
+    int get_moire_timings(double *out_ms, int count);
+]]
+
+ffi.cdef[[
+    int check_moire_kernels();
+]]
+
+ffi.cdef[[
+    int remove_moire_if_gray(unsigned char *fb_data, int width, int height, int line_length, int tolerance, float param_radius_min, float param_radius_max_diviser);
+]]
+
+ffi.cdef[[
+    int is_moire_frame_unchanged(unsigned char *fb_data, int width, int height, int line_length, int x, int y, int w, int h);
+]]
+
+ffi.cdef[[
+    void record_moire_frame(unsigned char *fb_data, int width, int height, int line_length);
+]]
+
+ffi.cdef[[
+    void set_moire_incremental(int enabled);
+]]
+
+ffi.cdef[[
+    int set_moire_engine(int engine, int tile_size);
+]]
+
+ffi.cdef[[
+    int set_moire_decimation(int factor);
+]]
+
+ffi.cdef[[
+    int moire_async_start(unsigned char *fb_data, int width, int height, int line_length, int tolerance, float param_radius_min, float param_radius_max_diviser);
+]]
+
+ffi.cdef[[
+    int moire_async_poll(unsigned char *fb_data, int width, int height, int line_length);
+]]
+
+ffi.cdef[[
+    void set_moire_page_cache(size_t budget_bytes);
+]]
+
+ffi.cdef[[
+    int get_moire_page_cache_stats(size_t *out, int count);
+]]
+
+ffi.cdef[[
+    void set_moire_skip_threshold(float threshold);
+]]
+
+ffi.cdef[[
+    int get_moire_probe(double *out, int count);
+]]
+
+local moire_timings = ffi.new("double[6]")
+local page_cache_stats = ffi.new("size_t[4]")
+local moire_probe = ffi.new("double[3]")
+
+-- Résultats des fonctions de filtrage de moire_filter_fftw_eco
+local MOIRE_FILTERED = 0
+local MOIRE_COLORED = 1
+local MOIRE_UNCHANGED = 2
+local MOIRE_PENDING = 3
+local MOIRE_STALE = 4
+local MOIRE_SKIPPED = 5
+
+-- Niveaux de qualité de remove_moire_rect_quality
+local MOIRE_QUALITY_FULL = 0
+
+moire.set_moire_padding(param_padding)
+moire.set_moire_lean_mode(param_lean_mode and 1 or 0)
+moire.set_moire_incremental(param_incremental and 1 or 0)
+moire.set_moire_page_cache(param_page_cache_mb * 1024 * 1024)
+moire.set_moire_skip_threshold(param_skip_threshold)
+if moire.set_moire_engine(param_engine, param_engine_tile_size) ~= 0 then
+	logger.warn("CFA interference breaker: invalid engine settings", param_engine, param_engine_tile_size)
+end
+if moire.set_moire_decimation(param_decimation) ~= 0 then
+	logger.warn("CFA interference breaker: invalid decimation factor", param_decimation)
+end
+
+-- Chargement de la sagesse FFTW au démarrage (absente au premier lancement)
+if moire.load_moire_wisdom(wisdom_path) ~= 0 then
+	logger.info("CFA interference breaker: no FFTW wisdom loaded from", wisdom_path)
+end
+
+-- Vérification des noyaux de conversion NEON contre leur version scalaire
+if moire.check_moire_kernels() ~= 0 then
+	logger.warn("CFA interference breaker: NEON conversion kernels differ from scalar reference")
+end
+
 
 -- Appel de la fonction sur le framebuffer
 local function remove_moire_on_fb(fb)
@@ -39,20 +218,52 @@ local function remove_moire_on_fb(fb)
 	local width = fb._vinfo.width
 	local height = fb._vinfo.height
 	local line_length  = fb._finfo.line_length
-    moire.remove_moire(fb_data, width, height, line_length, param_radius_min, param_radius_max_diviser)
+    return moire.remove_moire(fb_data, width, height, line_length, param_radius_min, param_radius_max_diviser)
+end
+
+-- Appel de la fonction sur un rectangle du framebuffer (coordonnées physiques)
+local function remove_moire_rect_on_fb(fb, x, y, w, h, quality)
+	return moire.remove_moire_rect_quality(fb.data, fb._vinfo.width, fb._vinfo.height, fb._finfo.line_length,
+		x, y, w, h, quality or MOIRE_QUALITY_FULL, param_radius_min, param_radius_max_diviser)
+end
+
+-- Suppression du moiré sur l'écran complet, sauf s'il contient de la couleur
+-- (détection et conversion en luminance en une seule lecture du framebuffer)
+-- Retourne MOIRE_FILTERED, MOIRE_COLORED (framebuffer laissé intact) ou MOIRE_UNCHANGED
+local function remove_moire_if_gray_on_fb(fb, tolerance)
+	if not fft_initialized then
+		moire.init_moire_resources()
+		fft_initialized = true
+	end
+	return moire.remove_moire_if_gray(fb.data, fb._vinfo.width, fb._vinfo.height, fb._finfo.line_length,
+		tolerance or 20, param_radius_min, param_radius_max_diviser)
+end
+
+-- Vrai si la zone (écran complet si x est nil) est identique à la dernière image produite :
+-- le rafraîchissement est redondant, refiltrer ne ferait que dégrader l'image
+local function framebuffer_unchanged(fb, x, y, w, h)
+	return moire.is_moire_frame_unchanged(fb.data, fb._vinfo.width, fb._vinfo.height, fb._finfo.line_length,
+		x or 0, y or 0, w or 0, h or 0) == 1
+end
+
+-- Enregistre l'écran complet comme dernière image produite (après un ajustement des couleurs)
+local function record_frame(fb)
+	moire.record_moire_frame(fb.data, fb._vinfo.width, fb._vinfo.height, fb._finfo.line_length)
 end
 
 -- Fonction qui analyse un framebuffer pour détecter la présence de couleur
-local function framebuffer_has_color(fb, tolerance)
+-- sampled : échantillonnage seul (plus rapide, une petite zone colorée peut échapper)
+local function framebuffer_has_color(fb, tolerance, sampled)
     -- Valeur de tolérance par défaut
     tolerance = tolerance or 20  -- Valeur par défaut identique au code original
     -- Appel de la fonction C avec les données du framebuffer
-    local is_colored = color_detect.is_framebuffer_colored(
+    local is_colored = color_detect.is_framebuffer_colored_mode(
         fb.data,
         fb._vinfo.width,
         fb._vinfo.height,
         fb._finfo.line_length,
-        tolerance
+        tolerance,
+        sampled and 1 or 0
     )
 	
     if not is_colored and not fft_initialized then
@@ -83,9 +294,10 @@ local original_beforeSuspend = PowerD.beforeSuspend
 function PowerD:beforeSuspend()
     --print("La liseuse passe en veille - exécution du code de nettoyage")
 	
+	-- Seuls les gros buffers (et le cache des pages) sont libérés : les plans FFTW sont conservés pour que
+	-- la première page au réveil soit aussi rapide que les suivantes
 	if fft_initialized then
-        moire.cleanup_moire_resources()
-		fft_initialized = false
+        moire.trim_moire_resources()
     end
 	
     -- Puis appeler la fonction originale pour permettre la mise en veille normale
@@ -100,20 +312,138 @@ local function _adjustAreaColours(fb)
     end
 end
 
-local function _adjustAreaBW(fb)		
-    fb.debug("adjusting image BW")
-	remove_moire_on_fb(fb)
+-- Score de la sonde d'énergie de la dernière page et décision (réglage de param_skip_threshold)
+local function _logMoireProbe(fb)
+	if param_skip_threshold > 0 then
+		moire.get_moire_probe(moire_probe, 3)
+		fb.debug("moire probe score/skipped/threshold", moire_probe[0], moire_probe[1], moire_probe[2])
+	end
 end
 
-local function _updateFull(fb, x, y, w, h, dither)
-    fb.debug("refresh: inkview full", x, y, w, h, dither, fb.device.hasColorScreen(), fb.device)
-	
-	if (dither and framebuffer_has_color(fb, 20)) then
+local function _logMoireFilter(fb)
+	-- Sauvegarde de la sagesse si de nouveaux plans viennent d'être mesurés
+	moire.save_moire_wisdom()
+	fb.debug("moire filter peak memory (bytes)", tonumber(moire.get_moire_peak_bytes()))
+	moire.get_moire_timings(moire_timings, 6)
+	fb.debug("moire filter timings (ms) load/fft/filter/ifft/store/total",
+		moire_timings[0], moire_timings[1], moire_timings[2],
+		moire_timings[3], moire_timings[4], moire_timings[5])
+	if param_page_cache_mb > 0 then
+		moire.get_moire_page_cache_stats(page_cache_stats, 4)
+		fb.debug("moire page cache hits/misses/pages/bytes", tonumber(page_cache_stats[0]),
+			tonumber(page_cache_stats[1]), tonumber(page_cache_stats[2]), tonumber(page_cache_stats[3]))
+	end
+end
+
+local function _adjustAreaBW(fb, x, y, w, h, quality)
+    fb.debug("adjusting image BW", x, y, w, h, quality)
+	local rc
+	if x then
+		rc = remove_moire_rect_on_fb(fb, x, y, w, h, quality)
+	else
+		rc = remove_moire_on_fb(fb)
+	end
+	if rc == MOIRE_UNCHANGED then
+		fb.debug("image unchanged since last filtering, skipped")
+	elseif rc == MOIRE_SKIPPED and x then
+		fb.debug("filtering bypassed for this refresh")
+	elseif rc == MOIRE_SKIPPED then
+		fb.debug("no moire expected on this image, filtering skipped")
+		_logMoireProbe(fb)
+	else
+		_logMoireProbe(fb)
+		_logMoireFilter(fb)
+	end
+end
+
+-- Carte des tuiles colorées, réallouée seulement si le nombre de tuiles change
+local color_tiles, color_tiles_count = nil, 0
+
+-- Page mixte : suppression du moiré hors des tuiles colorées, ajustement des couleurs dans celles-ci
+-- Retourne false si la page est entièrement en couleur (rien n'est modifié)
+local function _adjustAreaMixed(fb, tolerance)
+	local width, height = fb._vinfo.width, fb._vinfo.height
+	local line_length = fb._finfo.line_length
+	local tiles_x = math.ceil(width / param_tile_size)
+	local tiles_y = math.ceil(height / param_tile_size)
+
+	if color_tiles_count ~= tiles_x * tiles_y then
+		color_tiles_count = tiles_x * tiles_y
+		color_tiles = ffi.new("uint8_t[?]", color_tiles_count)
+	end
+
+	local colored = color_detect.framebuffer_color_tiles(fb.data, width, height, line_length,
+		tolerance, param_tile_size, color_tiles, color_tiles_count)
+	if colored <= 0 or colored == color_tiles_count then
+		return false
+	end
+
+	fb.debug("adjusting mixed image", colored, "colored tiles out of", color_tiles_count)
+	moire.remove_moire_masked(fb.data, width, height, line_length, color_tiles, param_tile_size,
+		param_radius_min, param_radius_max_diviser)
+	_logMoireFilter(fb)
+
+	if fb.device.hasColorScreen() then
+		-- Ajustement des couleurs par suites de tuiles colorées sur chaque ligne de tuiles
+		local data = ffi.cast("uint8_t *", fb.data)
+		for ty = 0, tiles_y - 1 do
+			local y = ty * param_tile_size
+			local h = math.min(param_tile_size, height - y)
+			local tx = 0
+			while tx < tiles_x do
+				if color_tiles[ty * tiles_x + tx] ~= 0 then
+					local first = tx
+					while tx < tiles_x and color_tiles[ty * tiles_x + tx] ~= 0 do
+						tx = tx + 1
+					end
+					local x = first * param_tile_size
+					local w = math.min(tx * param_tile_size, width) - x
+					inkview.adjustAreaDefault(data + y * line_length + x * 3, line_length, w, h)
+				else
+					tx = tx + 1
+				end
+			end
+		end
+	end
+	return true
+end
+
+-- Page en couleur : ajustement des couleurs (par zones si la page est mixte)
+local function _adjustAreaColoured(fb, tolerance)
+	if not (param_color_tiles and _adjustAreaMixed(fb, tolerance)) then
 		_adjustAreaColours(fb)
+	end
+	-- Un nouveau rafraîchissement du même contenu ne réajustera pas les couleurs
+	record_frame(fb)
+end
+
+-- Écran complet : filtre le moiré si l'image est en noir et blanc, sinon ajuste les couleurs
+-- (par zones si la page est mixte)
+local function _adjustAreaAuto(fb, tolerance)
+	local rc = remove_moire_if_gray_on_fb(fb, tolerance)
+	if rc == MOIRE_UNCHANGED then
+		fb.debug("image unchanged since last adjustment, skipped")
+	elseif rc == MOIRE_SKIPPED then
+		fb.debug("no moire expected on this image, filtering skipped")
+		_logMoireProbe(fb)
+	elseif rc ~= MOIRE_COLORED then
+		fb.debug("adjusting image BW (fused color detection)")
+		_logMoireProbe(fb)
+		_logMoireFilter(fb)
+	else
+		_adjustAreaColoured(fb, tolerance)
+	end
+end
+
+local function _adjustAreaFull(fb, dither)
+	if dither then
+		_adjustAreaAuto(fb, 20)
 	else
 		_adjustAreaBW(fb)
-    end
+	end
+end
 
+local function _refreshFull(fb)
     if fb.device.hasColorScreen() then
         inkview.FullUpdateHQ()
     else
@@ -121,16 +451,83 @@ local function _updateFull(fb, x, y, w, h, dither)
     end
 end
 
+-- Rafraîchissement complet en attente du filtrage asynchrone (le plus récent seulement)
+local async_fb, async_dither, async_polling = nil, false, false
+local _pollAsyncFull
+
+-- Lance le filtrage de l'écran complet en arrière-plan
+-- Retourne false si l'écran doit être traité de façon synchrone (image déjà produite, erreur)
+local function _startAsyncFull(fb, dither)
+	if not fft_initialized then
+		moire.init_moire_resources()
+		fft_initialized = true
+	end
+	if framebuffer_unchanged(fb) then
+		return false
+	end
+	if moire.moire_async_start(fb.data, fb._vinfo.width, fb._vinfo.height, fb._finfo.line_length,
+			dither and 20 or -1, param_radius_min, param_radius_max_diviser) ~= 0 then
+		return false
+	end
+	-- Une demande encore en cours est remplacée : seule la dernière page sera affichée
+	async_fb, async_dither = fb, dither
+	if not async_polling then
+		async_polling = true
+		UIManager:scheduleIn(param_async_poll, _pollAsyncFull)
+	end
+	return true
+end
+
+_pollAsyncFull = function()
+	local fb = async_fb
+	local rc = moire.moire_async_poll(fb.data, fb._vinfo.width, fb._vinfo.height, fb._finfo.line_length)
+	if rc == MOIRE_PENDING then
+		UIManager:scheduleIn(param_async_poll, _pollAsyncFull)
+		return
+	end
+	async_polling = false
+
+	if rc == MOIRE_FILTERED then
+		fb.debug("adjusting image BW (background)")
+		_logMoireFilter(fb)
+	elseif rc == MOIRE_COLORED then
+		_adjustAreaColoured(fb, 20)
+	elseif rc == MOIRE_STALE and _startAsyncFull(fb, async_dither) then
+		-- L'écran a changé pendant le filtrage : l'image actuelle est refiltrée
+		fb.debug("screen changed during background filtering, restarted")
+		return
+	else
+		_adjustAreaFull(fb, async_dither)
+	end
+	_refreshFull(fb)
+end
+
+local function _updateFull(fb, x, y, w, h, dither)
+    fb.debug("refresh: inkview full", x, y, w, h, dither, fb.device.hasColorScreen(), fb.device)
+	
+	-- L'écran sera rafraîchi par _pollAsyncFull une fois l'image filtrée
+	if param_async and _startAsyncFull(fb, dither) then
+		return
+	end
+
+	_adjustAreaFull(fb, dither)
+	_refreshFull(fb)
+end
+
 local function _updatePartial(fb, x, y, w, h, dither, hq)
     -- Use "hq" argument to trigger high quality refresh for color Pocketbook devices.
 	x, y, w, h = _getPhysicalRect(fb, x, y, w, h)
 
     fb.debug("refresh: inkview partial", x, y, w, h, dither)
 
-    if (dither and framebuffer_has_color(fb, 20)) then
+    -- Rafraîchissement redondant (flash après un partiel, UI sur une page inchangée)
+    if framebuffer_unchanged(fb, x, y, w, h) then
+		fb.debug("refresh area unchanged since last adjustment, skipped")
+    elseif (dither and framebuffer_has_color(fb, 20)) then
 		_adjustAreaColours(fb)
+		record_frame(fb)
 	else
-		_adjustAreaBW(fb)
+		_adjustAreaBW(fb, x, y, w, h)
     end
 
     if fb.device.hasColorScreen() and hq then
@@ -145,10 +542,14 @@ local function _updateFast(fb, x, y, w, h, dither)
 
     fb.debug("refresh: inkview fast", x, y, w, h, dither)
 
-    if (dither and framebuffer_has_color(fb, 20)) then
+    -- Rafraîchissement rapide : l'échantillonnage suffit à reconnaître une page en couleur
+    if framebuffer_unchanged(fb, x, y, w, h) then
+		fb.debug("refresh area unchanged since last adjustment, skipped")
+    elseif (dither and framebuffer_has_color(fb, 20, true)) then
 		_adjustAreaColours(fb)
+		record_frame(fb)
 	else
-		_adjustAreaBW(fb)
+		_adjustAreaBW(fb, x, y, w, h, param_fast_quality)
     end
 
     inkview.DynamicUpdate(x, y, w, h)
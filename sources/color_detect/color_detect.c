@@ -1,206 +1,311 @@
-/**
- * color_detect.c - Détection efficace de pixels colorés dans un framebuffer
- * 
- * Ce code permet de déterminer si une image contient des pixels colorés (non gris)
- * en utilisant des optimisations NEON, OpenMP et une gestion efficace de la mémoire.
- * Format d'image attendu: RGB 24-bit (3 octets par pixel)
- */
-
-#include <stdint.h>
-#include <stdbool.h>
-#include <stdlib.h>
-#include <string.h>
-#include <omp.h>
-
-#ifdef __ARM_NEON
-#include <arm_neon.h>
-#endif
-
-/* Définition de l'export pour l'utilisation en tant que bibliothèque partagée */
-#ifdef __GNUC__
-#define EXPORT __attribute__((visibility("default")))
-#else
-#define EXPORT
-#endif
-
-/* Alignement mémoire optimal pour les opérations SIMD */
-#define MEM_ALIGN 16
-
-/**
- * Détermine si un pixel unique est coloré (non gris) en comparant les canaux R, G, B
- * Un pixel est considéré comme coloré si la différence entre deux canaux
- * quelconques dépasse la tolérance spécifiée.
- */
-static inline bool is_pixel_colored(uint8_t r, uint8_t g, uint8_t b, int tolerance) {
-    /* Un pixel est coloré si la différence entre deux canaux quelconques est supérieure à la tolérance */
-    return (abs(r - g) > tolerance) || 
-           (abs(r - b) > tolerance) || 
-           (abs(g - b) > tolerance);
-}
-
-/**
- * Version scalaire (non-NEON) pour analyser un bloc de pixels
- * Cette fonction est utilisée comme fallback lorsque NEON n'est pas disponible
- * ou pour les bords de l'image qui ne peuvent pas être traités par paquets.
- */
-static bool is_block_colored_scalar(const uint8_t* data, int stride, 
-                                    int x_start, int y_start,
-                                    int block_width, int block_height,
-                                    int img_width, int img_height,
-                                    int tolerance) __attribute__((unused));
-
-static bool is_block_colored_scalar(const uint8_t* data, int stride, 
-                                    int x_start, int y_start,
-                                    int block_width, int block_height,
-                                    int img_width, int img_height, 
-                                    int tolerance) {
-    /* Parcours du bloc de pixels */
-    for (int y = y_start; y < y_start + block_height && y < img_height; y++) {
-        const uint8_t* row = data + (y * stride);
-        
-        for (int x = x_start; x < x_start + block_width && x < img_width; x++) {
-            /* Pour chaque pixel, récupération des composantes RGB - 3 octets par pixel */
-            const uint8_t* px = row + (x * 3);
-            
-            /* Si le pixel est coloré, on peut arrêter immédiatement */
-            if (is_pixel_colored(px[0], px[1], px[2], tolerance)) {
-                return true;
-            }
-        }
-    }
-    
-    /* Aucun pixel coloré trouvé dans ce bloc */
-    return false;
-}
-
-#ifdef __ARM_NEON
-/**
- * Version optimisée avec NEON pour traiter plusieurs pixels en parallèle
- * Cette fonction analyse un bloc d'image en utilisant les instructions SIMD NEON
- * pour une performance optimale sur les architectures ARM.
- */
-static bool is_block_colored_neon(const uint8_t* data, int stride,
-                                  int x_start, int y_start,
-                                  int block_width, int block_height,
-                                  int img_width, int img_height,
-                                  int tolerance) {
-    const uint8_t tol = (uint8_t)tolerance;
-    uint8x8_t tolerance_vec = vdup_n_u8(tol);
-    
-    /* Parcours ligne par ligne dans le bloc */
-    for (int y = y_start; y < y_start + block_height && y < img_height; y++) {
-        const uint8_t* row = data + (y * stride);
-        
-        /* Traitement de 8 pixels à la fois (3 octets par pixel = 24 octets) */
-        for (int x = x_start; x < x_start + block_width && x < img_width; x += 8) {
-            /* Vérification des limites */
-            if (x + 8 > img_width) {
-                /* Traitement des pixels restants avec la méthode scalaire */
-                for (int i = x; i < img_width; i++) {
-                    const uint8_t* px = row + (i * 3);
-                    if (is_pixel_colored(px[0], px[1], px[2], tolerance)) {
-                        return true;
-                    }
-                }
-                break;
-            }
-            
-            /* Préchargement des données pour réduire les latences mémoire */
-            __builtin_prefetch(row + ((x + 16) * 3), 0, 0);
-            
-            /* Chargement des 8 pixels (24 octets) avec désentrelacement des canaux RGB */
-            uint8x8x3_t pixels = vld3_u8(row + (x * 3));
-            
-            /* Extraction des canaux R, G, B */
-            uint8x8_t r_channel = pixels.val[0];
-            uint8x8_t g_channel = pixels.val[1];
-            uint8x8_t b_channel = pixels.val[2];
-            
-            /* Calcul des différences absolues entre canaux */
-            uint8x8_t diff_rg = vabd_u8(r_channel, g_channel);
-            uint8x8_t diff_rb = vabd_u8(r_channel, b_channel);
-            uint8x8_t diff_gb = vabd_u8(g_channel, b_channel);
-            
-            /* Comparaison avec la tolérance */
-            uint8x8_t mask_rg = vcgt_u8(diff_rg, tolerance_vec);
-            uint8x8_t mask_rb = vcgt_u8(diff_rb, tolerance_vec);
-            uint8x8_t mask_gb = vcgt_u8(diff_gb, tolerance_vec);
-            
-            /* Combinaison des masques (OR logique) */
-            uint8x8_t mask = vorr_u8(vorr_u8(mask_rg, mask_rb), mask_gb);
-            
-            /* Vérification si au moins un pixel est coloré dans ce groupe */
-            uint64_t mask_val = vget_lane_u64(vreinterpret_u64_u8(mask), 0);
-            if (mask_val != 0) {
-                return true;
-            }
-        }
-    }
-    
-    /* Aucun pixel coloré trouvé dans ce bloc */
-    return false;
-}
-#endif
-
-/**
- * Fonction principale exportée pour l'interface Lua
- * Analyse un framebuffer pour déterminer s'il contient des pixels colorés
- * 
- * @param data Pointeur vers les données de l'image (format RGB 24 bits)
- * @param width Largeur de l'image en pixels
- * @param height Hauteur de l'image en pixels
- * @param stride Longueur d'une ligne en octets (scanline)
- * @param tolerance Seuil de différence entre les canaux pour considérer un pixel comme coloré
- * @return true si l'image contient au moins un pixel coloré, false sinon
- */
-EXPORT bool is_framebuffer_colored(uint8_t* data, int width, int height, int stride, int tolerance) {
-    /* Paramètres optimaux pour les blocs de traitement */
-    const int BLOCK_WIDTH = 8;  /* Identique au code Lua pour la cohérence */
-    const int BLOCK_HEIGHT = 16;  /* Identique au code Lua pour la cohérence */
-    
-    /* Variable partagée pour indiquer si un pixel coloré a été trouvé */
-    volatile bool found_colored = false;
-    
-    /* Configuration du nombre optimal de threads */
-    int num_threads = omp_get_max_threads();
-    omp_set_num_threads(num_threads);
-    
-    /* Traitement parallèle par blocs avec OpenMP */
-    #pragma omp parallel
-    {
-        /* Distribution des blocs aux threads avec possibilité d'arrêt anticipé */
-        #pragma omp for collapse(2) schedule(dynamic)
-        for (int y = 0; y < height; y += BLOCK_HEIGHT) {
-            for (int x = 0; x < width; x += BLOCK_WIDTH) {
-                /* Vérification rapide si un autre thread a déjà trouvé un pixel coloré */
-                if (found_colored) {
-                    continue;
-                }
-                
-                bool block_has_color = false;
-                
-                /* Sélection de l'implémentation optimale */
-                #ifdef __ARM_NEON
-                block_has_color = is_block_colored_neon(data, stride, x, y,
-                                                       BLOCK_WIDTH, BLOCK_HEIGHT,
-                                                       width, height, tolerance);
-                #else
-                block_has_color = is_block_colored_scalar(data, stride, x, y,
-                                                         BLOCK_WIDTH, BLOCK_HEIGHT,
-                                                         width, height, tolerance);
-                #endif
-                
-                /* Si un pixel coloré est trouvé, mise à jour de la variable partagée */
-                if (block_has_color) {
-                    #pragma omp atomic write
-                    found_colored = true;
-                    
-                    /* Signaler aux autres threads de s'arrêter */
-                    #pragma omp cancel for
-                }
-            }
-        }
-    }
-    
-    return found_colored;
+/**
+ * color_detect.c - Détection efficace de pixels colorés dans un framebuffer
+ * 
+ * Ce code permet de déterminer si une image contient des pixels colorés (non gris)
+ * en utilisant des optimisations NEON, OpenMP et une gestion efficace de la mémoire.
+ * Format d'image attendu: RGB 24-bit (3 octets par pixel)
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+/* Définition de l'export pour l'utilisation en tant que bibliothèque partagée */
+#ifdef __GNUC__
+#define EXPORT __attribute__((visibility("default")))
+#else
+#define EXPORT
+#endif
+
+/* Alignement mémoire optimal pour les opérations SIMD */
+#define MEM_ALIGN 16
+
+/* Modes de détection de is_framebuffer_colored_mode */
+#define COLOR_DETECT_EXACT 0     /* Échantillonnage puis parcours complet si rien n'est trouvé */
+#define COLOR_DETECT_SAMPLED 1   /* Échantillonnage seul (réponse approchée, très rapide) */
+
+/* Nombre de lignes lues par la passe d'échantillonnage */
+#define SAMPLE_ROWS 64
+
+/**
+ * Détermine si un pixel unique est coloré (non gris) en comparant les canaux R, G, B
+ * Un pixel est considéré comme coloré si la différence entre deux canaux
+ * quelconques dépasse la tolérance spécifiée.
+ */
+static inline bool is_pixel_colored(uint8_t r, uint8_t g, uint8_t b, int tolerance) {
+    /* Un pixel est coloré si la différence entre deux canaux quelconques est supérieure à la tolérance */
+    return (abs(r - g) > tolerance) || 
+           (abs(r - b) > tolerance) || 
+           (abs(g - b) > tolerance);
+}
+
+/**
+ * Version scalaire (non-NEON) pour analyser une ligne de pixels
+ * Cette fonction est utilisée comme fallback lorsque NEON n'est pas disponible
+ * ou pour les pixels de fin de ligne qui ne peuvent pas être traités par paquets.
+ */
+static bool is_row_colored_scalar(const uint8_t* row, int x_start, int x_end, int tolerance) {
+    for (int x = x_start; x < x_end; x++) {
+        /* Pour chaque pixel, récupération des composantes RGB - 3 octets par pixel */
+        const uint8_t* px = row + (x * 3);
+
+        /* Si le pixel est coloré, on peut arrêter immédiatement */
+        if (is_pixel_colored(px[0], px[1], px[2], tolerance)) {
+            return true;
+        }
+    }
+
+    /* Aucun pixel coloré trouvé dans cette ligne */
+    return false;
+}
+
+#ifdef __ARM_NEON
+/**
+ * Version optimisée avec NEON pour analyser les pixels [x_start, x_end[ d'une ligne
+ * 16 pixels (48 octets) sont traités par itération ; les masques sont accumulés
+ * et testés par groupes de 64 pixels pour limiter les transferts NEON → ARM.
+ */
+static bool is_row_colored_neon(const uint8_t* row, int x_start, int x_end, int tolerance) {
+    const uint8_t tol = (uint8_t)tolerance;
+    uint8x16_t tolerance_vec = vdupq_n_u8(tol);
+    int x = x_start;
+
+    while (x + 16 <= x_end) {
+        uint8x16_t mask = vdupq_n_u8(0);
+
+        /* Jusqu'à 4 paquets de 16 pixels avant de tester le masque accumulé */
+        for (int i = 0; i < 4 && x + 16 <= x_end; i++, x += 16) {
+            /* Préchargement des données pour réduire les latences mémoire */
+            __builtin_prefetch(row + ((x + 64) * 3), 0, 0);
+
+            /* Chargement des 16 pixels (48 octets) avec désentrelacement des canaux RGB */
+            uint8x16x3_t pixels = vld3q_u8(row + (x * 3));
+
+            /* Calcul des différences absolues entre canaux */
+            uint8x16_t diff_rg = vabdq_u8(pixels.val[0], pixels.val[1]);
+            uint8x16_t diff_rb = vabdq_u8(pixels.val[0], pixels.val[2]);
+            uint8x16_t diff_gb = vabdq_u8(pixels.val[1], pixels.val[2]);
+
+            /* Comparaison avec la tolérance et combinaison des masques (OR logique) */
+            mask = vorrq_u8(mask, vcgtq_u8(diff_rg, tolerance_vec));
+            mask = vorrq_u8(mask, vcgtq_u8(diff_rb, tolerance_vec));
+            mask = vorrq_u8(mask, vcgtq_u8(diff_gb, tolerance_vec));
+        }
+
+        /* Vérification si au moins un pixel est coloré dans ce groupe */
+        uint8x8_t folded = vorr_u8(vget_low_u8(mask), vget_high_u8(mask));
+        if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) != 0) {
+            return true;
+        }
+    }
+
+    /* Traitement des pixels restants avec la méthode scalaire */
+    return is_row_colored_scalar(row, x, x_end, tolerance);
+}
+#endif
+
+/**
+ * Analyse les pixels [x_start, x_end[ d'une ligne (sélection de l'implémentation optimale)
+ */
+static inline bool is_segment_colored(const uint8_t* row, int x_start, int x_end, int tolerance) {
+#ifdef __ARM_NEON
+    return is_row_colored_neon(row, x_start, x_end, tolerance);
+#else
+    return is_row_colored_scalar(row, x_start, x_end, tolerance);
+#endif
+}
+
+/**
+ * Analyse une ligne complète
+ */
+static inline bool is_row_colored(const uint8_t* row, int width, int tolerance) {
+    return is_segment_colored(row, 0, width, tolerance);
+}
+
+/**
+ * Passe d'échantillonnage : lecture de SAMPLE_ROWS lignes réparties sur la hauteur
+ * selon une suite à faible discrépance (suite de Weyl du nombre d'or). Les lignes
+ * lues couvrent uniformément l'image quel que soit leur nombre, sans motif régulier
+ * qui pourrait s'aligner sur celui de la page.
+ * Exécutée sur un seul thread : elle ne lit que quelques pourcents de l'image et
+ * le démarrage d'une région parallèle coûterait plus cher que la lecture.
+ */
+static bool is_sample_colored(const uint8_t* data, int width, int height, int stride, int tolerance) {
+    /* Partie fractionnaire de 1/phi en virgule fixe 32 bits */
+    const uint32_t GOLDEN_STEP = 0x9E3779B9u;
+    uint32_t position = GOLDEN_STEP / 2;
+    int rows = height < SAMPLE_ROWS ? height : SAMPLE_ROWS;
+
+    for (int i = 0; i < rows; i++, position += GOLDEN_STEP) {
+        int y = (int)(((uint64_t)position * (uint64_t)height) >> 32);
+        if (is_row_colored(data + (y * stride), width, tolerance)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Parcours complet de l'image
+ *
+ * Le travail est réparti par bandes de lignes entières (BAND_HEIGHT lignes) :
+ * peu d'unités à distribuer, et des lectures mémoire continues sur toute la largeur.
+ * L'arrêt anticipé repose sur un drapeau partagé testé à chaque ligne, et non sur
+ * "omp cancel" qui n'a d'effet que si OMP_CANCELLATION est défini dans l'environnement.
+ */
+static bool is_full_scan_colored(const uint8_t* data, int width, int height, int stride, int tolerance) {
+    /* Hauteur d'une unité de travail : ~100 bandes pour un écran de 1680 lignes */
+    const int BAND_HEIGHT = 16;
+    const int num_bands = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+
+    /* Variable partagée pour indiquer si un pixel coloré a été trouvé */
+    int found_colored = 0;
+
+    /* Traitement parallèle par bandes avec OpenMP */
+    #pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < num_bands; band++) {
+        const int y_end = (band + 1) * BAND_HEIGHT < height ? (band + 1) * BAND_HEIGHT : height;
+
+        for (int y = band * BAND_HEIGHT; y < y_end; y++) {
+            /* Vérification rapide si un autre thread a déjà trouvé un pixel coloré
+               (les bandes restantes sont alors parcourues sans lire l'image) */
+            int stop;
+            #pragma omp atomic read
+            stop = found_colored;
+            if (stop) {
+                break;
+            }
+
+            if (is_row_colored(data + (y * stride), width, tolerance)) {
+                #pragma omp atomic write
+                found_colored = 1;
+                break;
+            }
+        }
+    }
+
+    return found_colored != 0;
+}
+
+/**
+ * Analyse un framebuffer pour déterminer s'il contient des pixels colorés
+ *
+ * Une passe d'échantillonnage lit d'abord une petite partie des lignes : les pages
+ * en couleur sont en général reconnues dès cette passe. En mode exact, l'image est
+ * ensuite entièrement parcourue si l'échantillon ne contient pas de couleur.
+ *
+ * @param data Pointeur vers les données de l'image (format RGB 24 bits)
+ * @param width Largeur de l'image en pixels
+ * @param height Hauteur de l'image en pixels
+ * @param stride Longueur d'une ligne en octets (scanline)
+ * @param tolerance Seuil de différence entre les canaux pour considérer un pixel comme coloré
+ * @param mode COLOR_DETECT_EXACT ou COLOR_DETECT_SAMPLED (échantillon seul : une petite
+ *             zone colorée peut ne pas être vue)
+ * @return true si au moins un pixel coloré a été trouvé, false sinon
+ */
+EXPORT bool is_framebuffer_colored_mode(uint8_t* data, int width, int height, int stride,
+                                        int tolerance, int mode) {
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    /* Phase 1 : échantillonnage, réponse immédiate en cas de couleur */
+    if (is_sample_colored(data, width, height, stride, tolerance)) {
+        return true;
+    }
+
+    if (mode == COLOR_DETECT_SAMPLED) {
+        return false;
+    }
+
+    /* Phase 2 : confirmation par un parcours complet */
+    return is_full_scan_colored(data, width, height, stride, tolerance);
+}
+
+/**
+ * Fonction principale exportée pour l'interface Lua
+ * Analyse un framebuffer pour déterminer s'il contient des pixels colorés (mode exact)
+ *
+ * @param data Pointeur vers les données de l'image (format RGB 24 bits)
+ * @param width Largeur de l'image en pixels
+ * @param height Hauteur de l'image en pixels
+ * @param stride Longueur d'une ligne en octets (scanline)
+ * @param tolerance Seuil de différence entre les canaux pour considérer un pixel comme coloré
+ * @return true si l'image contient au moins un pixel coloré, false sinon
+ */
+EXPORT bool is_framebuffer_colored(uint8_t* data, int width, int height, int stride, int tolerance) {
+    return is_framebuffer_colored_mode(data, width, height, stride, tolerance, COLOR_DETECT_EXACT);
+}
+
+/**
+ * Construit la carte des tuiles colorées d'un framebuffer
+ *
+ * L'image est découpée en tuiles de tile_size x tile_size pixels (les tuiles du bord
+ * droit et du bas peuvent être plus petites). Chaque tuile reçoit 1 si elle contient
+ * au moins un pixel coloré, 0 sinon ; la lecture d'une tuile s'arrête à son premier
+ * pixel coloré. Permet de ne filtrer le moiré que dans les zones en noir et blanc
+ * d'une page mixte (voir remove_moire_masked de moire_filter_fftw_eco).
+ *
+ * @param data Pointeur vers les données de l'image (format RGB 24 bits)
+ * @param width Largeur de l'image en pixels
+ * @param height Hauteur de l'image en pixels
+ * @param stride Longueur d'une ligne en octets (scanline)
+ * @param tolerance Seuil de différence entre les canaux pour considérer un pixel comme coloré
+ * @param tile_size Côté des tuiles en pixels
+ * @param tiles Carte de sortie, ligne par ligne : ceil(width / tile_size) x ceil(height / tile_size) octets
+ * @param max_tiles Taille du tableau tiles
+ * @return Nombre de tuiles colorées, -1 si les paramètres sont invalides ou tiles trop petit
+ */
+EXPORT int framebuffer_color_tiles(uint8_t* data, int width, int height, int stride, int tolerance,
+                                   int tile_size, uint8_t* tiles, int max_tiles) {
+    if (width <= 0 || height <= 0 || tile_size <= 0 || !tiles) {
+        return -1;
+    }
+
+    const int tiles_x = (width + tile_size - 1) / tile_size;
+    const int tiles_y = (height + tile_size - 1) / tile_size;
+    if (tiles_x * tiles_y > max_tiles) {
+        return -1;
+    }
+
+    int colored_count = 0;
+
+    /* Une unité de travail par ligne de tuiles : lectures continues sur toute la largeur */
+    #pragma omp parallel for schedule(dynamic) reduction(+:colored_count)
+    for (int ty = 0; ty < tiles_y; ty++) {
+        uint8_t* tile_row = tiles + ty * tiles_x;
+        const int y_end = (ty + 1) * tile_size < height ? (ty + 1) * tile_size : height;
+        int remaining = tiles_x;
+
+        memset(tile_row, 0, tiles_x);
+
+        for (int y = ty * tile_size; y < y_end && remaining > 0; y++) {
+            const uint8_t* row = data + (y * stride);
+
+            for (int tx = 0; tx < tiles_x; tx++) {
+                /* Tuile déjà reconnue colorée : inutile de la relire */
+                if (tile_row[tx]) {
+                    continue;
+                }
+
+                const int x_start = tx * tile_size;
+                const int x_end = x_start + tile_size < width ? x_start + tile_size : width;
+                if (is_segment_colored(row, x_start, x_end, tolerance)) {
+                    tile_row[tx] = 1;
+                    remaining--;
+                }
+            }
+        }
+
+        colored_count += tiles_x - remaining;
+    }
+
+    return colored_count;
 }
\ No newline at end of file
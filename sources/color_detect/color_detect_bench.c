@@ -0,0 +1,112 @@
+/**
+ * color_detect_bench.c - Mesure des temps de is_framebuffer_colored sur la liseuse
+ *
+ * Compare le pire cas (image entièrement grise, parcourue en totalité) et le meilleur
+ * cas (pixel coloré dès la première ligne, arrêt anticipé), ainsi qu'un pixel coloré
+ * sur la dernière ligne, une illustration en couleur (reconnue par l'échantillonnage)
+ * et le mode échantillonnage seul. Les temps dépendent du processeur et du nombre de
+ * threads : à lancer sur la liseuse elle-même.
+ *
+ * Usage : color_detect_bench [<largeur>x<hauteur>] [itérations]
+ * Exemple : ./color_detect_bench 1264x1680 200
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <omp.h>
+
+bool is_framebuffer_colored_mode(uint8_t* data, int width, int height, int stride,
+                                 int tolerance, int mode);
+
+/* Tolérance utilisée par le patch Lua */
+#define BENCH_TOLERANCE 20
+
+/* Modes de détection (voir color_detect.c) */
+#define COLOR_DETECT_EXACT 0
+#define COLOR_DETECT_SAMPLED 1
+
+/**
+ * Remplit l'image d'un dégradé gris (les trois canaux identiques)
+ */
+static void fill_gray(uint8_t* data, int width, int height, int stride) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t v = (uint8_t)((x + y) & 0xFF);
+            data[y * stride + x * 3 + 0] = v;
+            data[y * stride + x * 3 + 1] = v;
+            data[y * stride + x * 3 + 2] = v;
+        }
+    }
+}
+
+/**
+ * Exécute la détection plusieurs fois et affiche les temps minimal et moyen
+ */
+static void bench_case(const char* name, uint8_t* data, int width, int height, int stride,
+                       int mode, int iterations, bool expected) {
+    double total = 0.0, best = 1e9;
+    bool result = expected;
+
+    for (int i = 0; i < iterations; i++) {
+        double start = omp_get_wtime();
+        result = is_framebuffer_colored_mode(data, width, height, stride, BENCH_TOLERANCE, mode);
+        double elapsed = (omp_get_wtime() - start) * 1000.0;
+        total += elapsed;
+        best = elapsed < best ? elapsed : best;
+    }
+
+    printf("%-28s min %8.3f ms   moy %8.3f ms%s\n", name, best, total / iterations,
+           result == expected ? "" : "   RÉSULTAT INCORRECT");
+}
+
+int main(int argc, char **argv) {
+    int width = 1264, height = 1680, iterations = 100;
+
+    if (argc > 1 && (sscanf(argv[1], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+        fprintf(stderr, "Usage : %s [<largeur>x<hauteur>] [itérations]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2) {
+        iterations = atoi(argv[2]);
+        iterations = iterations > 0 ? iterations : 1;
+    }
+
+    int stride = width * 3;
+    uint8_t* data = malloc((size_t)stride * height);
+    if (!data) {
+        fprintf(stderr, "Mémoire insuffisante\n");
+        return 1;
+    }
+
+    printf("%dx%d, %d threads, %d itérations\n", width, height, omp_get_max_threads(), iterations);
+
+    /* Pire cas : aucune couleur, toute l'image est lue */
+    fill_gray(data, width, height, stride);
+    bench_case("gris (pire cas)", data, width, height, stride, COLOR_DETECT_EXACT, iterations, false);
+    bench_case("gris, échantillon seul", data, width, height, stride, COLOR_DETECT_SAMPLED, iterations, false);
+
+    /* Meilleur cas : pixel coloré sur la première ligne */
+    data[(width / 2) * 3 + 1] ^= 0x80;
+    bench_case("couleur ligne 0 (meilleur)", data, width, height, stride, COLOR_DETECT_EXACT, iterations, true);
+    data[(width / 2) * 3 + 1] ^= 0x80;
+
+    /* Pixel coloré sur la dernière ligne */
+    data[(height - 1) * stride + (width / 2) * 3 + 1] ^= 0x80;
+    bench_case("couleur dernière ligne", data, width, height, stride, COLOR_DETECT_EXACT, iterations, true);
+    data[(height - 1) * stride + (width / 2) * 3 + 1] ^= 0x80;
+
+    /* Illustration en couleur sur le tiers central de la page */
+    for (int y = height / 3; y < 2 * height / 3; y++) {
+        for (int x = width / 4; x < 3 * width / 4; x++) {
+            data[y * stride + x * 3 + 0] = 200;
+            data[y * stride + x * 3 + 2] = 40;
+        }
+    }
+    bench_case("illustration couleur", data, width, height, stride, COLOR_DETECT_EXACT, iterations, true);
+
+    free(data);
+    return 0;
+}
@@ -0,0 +1,227 @@
+/**
+ * moire_engine_bench.c - Comparaison des moteurs de filtrage de moire_filter_fftw_eco
+ *
+ * Filtre une page synthétique (texte simulé sur une trame d'impression, qui produit le
+ * moiré) avec le moteur complet, le moteur par tuiles et le moteur spatial, puis affiche
+ * les temps, la mémoire de travail des moteurs FFT et l'écart de chaque sortie à celle
+ * du moteur complet (PSNR, et SSIM pour le moteur spatial). Le moteur complet décimé
+ * (facteurs 2 à 4) est comparé de la même façon au moteur complet, en signalant les
+ * facteurs pour lesquels le filtre réduit ne coupe rien (FFT sautée). Vérifie enfin que
+ * le cache des pages et le mode incrémental donnent la même image que le filtrage
+ * direct (page A, page B, retour à A depuis le cache, puis menu par-dessus). Les
+ * temps dépendent du processeur et du nombre de threads : à lancer sur la liseuse
+ * elle-même.
+ *
+ * Usage : moire_engine_bench [<largeur>x<hauteur>] [taille_tuile] [itérations]
+ * Exemple : ./moire_engine_bench 1264x1680 256 10
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int set_moire_engine(int engine, int tile_size);
+double compare_moire_engines(const unsigned char *fb_data, int width, int height, int line_length,
+                             float param_radius_min, float param_radius_max_diviser,
+                             double *results);
+double compare_moire_spatial(const unsigned char *fb_data, int width, int height, int line_length,
+                             float param_radius_min, float param_radius_max_diviser,
+                             double *results);
+double compare_moire_decimation(const unsigned char *fb_data, int width, int height, int line_length,
+                                float param_radius_min, float param_radius_max_diviser, int factor,
+                                double *results);
+int remove_moire(unsigned char *fb_data, int width, int height, int line_length,
+                 float param_radius_min, float param_radius_max_diviser);
+void set_moire_incremental(int enabled);
+void set_moire_page_cache(size_t budget_bytes);
+void cleanup_moire_resources(void);
+
+/* Paramètres du filtre utilisés par le patch Lua */
+#define BENCH_RADIUS_MIN 9999.0f
+#define BENCH_RADIUS_MAX_DIVISER 2.4f
+
+/* Moteurs de filtrage (voir moire_filter_fftw_eco.c) */
+#define MOIRE_ENGINE_FULL 0
+
+/* Facteurs de décimation comparés */
+#define BENCH_DECIMATION_MIN 2
+#define BENCH_DECIMATION_MAX 4
+
+/* Budget du cache des pages pour la vérification de cohérence */
+#define BENCH_PAGE_CACHE_BYTES (64u << 20)
+
+/**
+ * Remplit l'image d'une trame de points (période de 4 pixels) barrée de lignes de
+ * « texte » noires, les trois canaux identiques
+ */
+static void fill_page(unsigned char *data, int width, int height, int line_length) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int dot = ((x & 3) < 2) == ((y & 3) < 2);
+            int text = (y % 40) < 14 && (x % 11) < 7 && (x / 90 + y / 40) % 5 != 0;
+            unsigned char v = text ? 20 : (dot ? 235 : 160);
+            memset(&data[y * line_length + x * 3], v, 3);
+        }
+    }
+}
+
+/**
+ * Page A, page B, retour à A puis menu dessiné sur le bas de la sortie
+ * @param cached Cache des pages et mode incrémental activés (sinon filtrage direct)
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+static int run_page_sequence(unsigned char *data, unsigned char *page, int width, int height,
+                             int line_length, int cached) {
+    size_t size = (size_t)line_length * height;
+
+    cleanup_moire_resources();
+    set_moire_incremental(cached);
+    set_moire_page_cache(cached ? BENCH_PAGE_CACHE_BYTES : 0);
+
+    fill_page(page, width, height, line_length);
+    memcpy(data, page, size);
+    int rc = remove_moire(data, width, height, line_length, BENCH_RADIUS_MIN, BENCH_RADIUS_MAX_DIVISER);
+
+    // Page B : la page A inversée
+    for (size_t i = 0; i < size && rc >= 0; i++) {
+        data[i] = 255 - page[i];
+    }
+    if (rc >= 0) {
+        rc = remove_moire(data, width, height, line_length, BENCH_RADIUS_MIN, BENCH_RADIUS_MAX_DIVISER);
+    }
+    if (rc >= 0) {
+        memcpy(data, page, size);
+        rc = remove_moire(data, width, height, line_length, BENCH_RADIUS_MIN, BENCH_RADIUS_MAX_DIVISER);
+    }
+
+    // Menu clair sur les deux tiers inférieurs de la sortie de A
+    for (int y = height / 3; y < height && rc >= 0; y++) {
+        for (int x = 0; x < width; x++) {
+            memset(&data[y * line_length + x * 3], 240 - (x % 7) * 10, 3);
+        }
+    }
+    if (rc >= 0) {
+        rc = remove_moire(data, width, height, line_length, BENCH_RADIUS_MIN, BENCH_RADIUS_MAX_DIVISER);
+    }
+
+    set_moire_page_cache(0);
+    set_moire_incremental(0);
+    return rc < 0 ? -1 : 0;
+}
+
+/**
+ * Vérifie que le cache des pages et le mode incrémental donnent la même image que le
+ * filtrage direct quand on revient à une page depuis le cache : aucune tuile de la page
+ * intermédiaire ne doit réapparaître
+ * @return Écart maximal (niveaux de gris) entre les deux images, -1 en cas d'erreur
+ */
+static int check_page_cache(unsigned char *data, int width, int height, int line_length) {
+    size_t size = (size_t)line_length * height;
+    unsigned char *page = malloc(size), *reference = malloc(size);
+    int max_diff = -1;
+
+    if (page && reference &&
+        run_page_sequence(reference, page, width, height, line_length, 0) == 0 &&
+        run_page_sequence(data, page, width, height, line_length, 1) == 0) {
+        max_diff = 0;
+        for (size_t i = 0; i < size; i++) {
+            int diff = abs(data[i] - reference[i]);
+            max_diff = diff > max_diff ? diff : max_diff;
+        }
+    }
+
+    cleanup_moire_resources();
+    free(page);
+    free(reference);
+    return max_diff;
+}
+
+int main(int argc, char **argv) {
+    int width = 1264, height = 1680, tile_size = 256, iterations = 10;
+
+    if (argc > 1 && (sscanf(argv[1], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+        fprintf(stderr, "Usage : %s [<largeur>x<hauteur>] [taille_tuile] [itérations]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2) {
+        tile_size = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        iterations = atoi(argv[3]);
+        iterations = iterations > 0 ? iterations : 1;
+    }
+    if (set_moire_engine(MOIRE_ENGINE_FULL, tile_size) != 0) {
+        fprintf(stderr, "Taille de tuile invalide : %d (puissance de 2 de 64 à 512)\n", tile_size);
+        return 1;
+    }
+
+    int line_length = width * 3;
+    unsigned char *data = malloc((size_t)line_length * height);
+    if (!data) {
+        fprintf(stderr, "Mémoire insuffisante\n");
+        return 1;
+    }
+    fill_page(data, width, height, line_length);
+
+    double best_full = 1e9, best_tiled = 1e9, best_spatial = 1e9, results[4] = {0};
+    double spatial_results[3] = {0};
+    double psnr = -1.0, spatial_psnr = -1.0;
+    double best_decimated[BENCH_DECIMATION_MAX + 1], decimated_bytes[BENCH_DECIMATION_MAX + 1];
+    double decimated_psnr[BENCH_DECIMATION_MAX + 1];
+    int decimated_skipped[BENCH_DECIMATION_MAX + 1];
+    for (int f = BENCH_DECIMATION_MIN; f <= BENCH_DECIMATION_MAX; f++) {
+        best_decimated[f] = 1e9;
+        decimated_bytes[f] = 0.0;
+        decimated_psnr[f] = -1.0;
+        decimated_skipped[f] = 0;
+    }
+    for (int i = 0; i < iterations; i++) {
+        psnr = compare_moire_engines(data, width, height, line_length,
+                                     BENCH_RADIUS_MIN, BENCH_RADIUS_MAX_DIVISER, results);
+        if (psnr < 0.0) {
+            fprintf(stderr, "Échec du filtrage\n");
+            free(data);
+            return 1;
+        }
+        best_full = results[0] < best_full ? results[0] : best_full;
+        best_tiled = results[1] < best_tiled ? results[1] : best_tiled;
+
+        spatial_psnr = compare_moire_spatial(data, width, height, line_length,
+                                             BENCH_RADIUS_MIN, BENCH_RADIUS_MAX_DIVISER, spatial_results);
+        best_spatial = spatial_results[1] < best_spatial ? spatial_results[1] : best_spatial;
+
+        for (int f = BENCH_DECIMATION_MIN; f <= BENCH_DECIMATION_MAX; f++) {
+            double decimated_results[5] = {0};
+            decimated_psnr[f] = compare_moire_decimation(data, width, height, line_length,
+                                                         BENCH_RADIUS_MIN, BENCH_RADIUS_MAX_DIVISER, f,
+                                                         decimated_results);
+            best_decimated[f] = decimated_results[1] < best_decimated[f] ? decimated_results[1] : best_decimated[f];
+            decimated_bytes[f] = decimated_results[3];
+            decimated_skipped[f] = decimated_results[4] != 0.0;
+        }
+    }
+
+    printf("Image %dx%d, tuiles %d, %d itérations\n", width, height, tile_size, iterations);
+    printf("  moteur complet   : %8.2f ms  %8.1f Kio\n", best_full, results[2] / 1024.0);
+    printf("  moteur par tuiles: %8.2f ms  %8.1f Kio\n", best_tiled, results[3] / 1024.0);
+    printf("  moteur spatial   : %8.2f ms\n", best_spatial);
+    printf("  PSNR tuiles / complet : %.1f dB\n", psnr);
+    printf("  PSNR spatial / complet : %.1f dB, SSIM %.4f\n", spatial_psnr, spatial_results[2]);
+    for (int f = BENCH_DECIMATION_MIN; f <= BENCH_DECIMATION_MAX; f++) {
+        printf("  complet décimé x%d : %8.2f ms  %8.1f Kio, PSNR / complet : %.1f dB%s\n",
+               f, best_decimated[f], decimated_bytes[f] / 1024.0, decimated_psnr[f],
+               decimated_skipped[f] ? " (sans FFT : la coupure dépasse les fréquences réduites)" : "");
+    }
+
+    int page_diff = check_page_cache(data, width, height, line_length);
+    if (page_diff < 0) {
+        fprintf(stderr, "Échec du filtrage\n");
+        free(data);
+        return 1;
+    }
+    printf("  cache des pages + incrémental / direct : écart max %d\n", page_diff);
+
+    cleanup_moire_resources();
+    free(data);
+    return 0;
+}
\ No newline at end of file
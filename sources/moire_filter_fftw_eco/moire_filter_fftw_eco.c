@@ -1,361 +1,5168 @@
-#include <math.h>
-#include <string.h>
-#include <omp.h>
-#include "fftw3.h"
-
-#ifdef __GNUC__
-#define EXPORT __attribute__((visibility("default")))
-#else
-#define EXPORT
-#endif
-
-
-// Constantes pour le traitement par blocs et l'optimisation mémoire
-#define BLOCK_WIDTH 32
-#define BLOCK_HEIGHT 32
-#define PI 3.14159265358979323846f
-
-// Préchargement mémoire pour optimiser les accès
-#define PREFETCH(ptr) __builtin_prefetch(ptr)
-
-// Variables globales pour les plans FFT et les buffers
-static fftwf_plan g_fft2d_plan = NULL;
-static float *g_fft_input_tmp = NULL;
-static fftwf_complex *g_fft_result = NULL;
-
-static fftwf_plan g_ifft2d_plan = NULL;
-static fftwf_complex *g_ifft_input_tmp = NULL;
-static float *g_ifft_result = NULL;
-
-static int g_width = 0;
-static int g_height = 0;
-static int g_line_length = 0;
-static int g_initialized = 0;
-
-/**
- * Libère les ressources FFTW
- */
-void cleanup_fftw_resources() {
-    if (g_fft2d_plan) {
-        fftwf_destroy_plan(g_fft2d_plan);
-        g_fft2d_plan = NULL;
-    }
-    
-    if (g_fft_input_tmp) {
-        fftwf_free(g_fft_input_tmp);
-        g_fft_input_tmp = NULL;
-    }
-    
-    if (g_fft_result) {
-        fftwf_free(g_fft_result);
-        g_fft_result = NULL;
-    }
-	
-    if (g_ifft2d_plan) {
-        fftwf_destroy_plan(g_ifft2d_plan);
-        g_ifft2d_plan = NULL;
-    }
-	
-    if (g_ifft_input_tmp) {
-        fftwf_free(g_ifft_input_tmp);
-        g_ifft_input_tmp = NULL;
-    }
-    
-    if (g_ifft_result) {
-        fftwf_free(g_ifft_result);
-        g_ifft_result = NULL;
-    }
-    
-    g_width = 0;
-    g_height = 0;
-	g_line_length = 0;
-    g_initialized = 0;
-}
-
-/**
- * Initialise les ressources FFTW pour la réutilisation
- * @param width Largeur de l'image
- * @param height Hauteur de l'image
- * @return 0 en cas de succès, -1 en cas d'erreur
- */
-int init_fftw_resources(int width, int height, int line_length) {
-    // Si déjà initialisé avec les mêmes dimensions, pas besoin de réinitialiser
-    if (g_initialized && g_width == width && g_height == height && g_line_length == line_length) {
-        return 0;
-    }
-    
-    // Nettoyer les ressources existantes si nécessaire
-    cleanup_fftw_resources();
-    
-    // Initialiser FFTW avec support multi-threading (optionnel, à faire une seule fois)
-    fftwf_init_threads();
-    fftwf_plan_with_nthreads(omp_get_max_threads());
-    
-    // Allouer la mémoire
-    g_fft_input_tmp = fftwf_malloc(sizeof(float) * width * height);
-    g_fft_result = fftwf_malloc(sizeof(fftwf_complex) * width * height);
-	
-	g_ifft_result = fftwf_malloc(sizeof(float) * width * height);
-    g_ifft_input_tmp = fftwf_malloc(sizeof(fftwf_complex) * height * (width/2 + 1));    
-
-	if (!g_fft_input_tmp || !g_fft_result || !g_ifft_input_tmp || !g_ifft_result) {
-        cleanup_fftw_resources();
-        return -1;
-    }
-    
-    // Créer les plans FFT
-    g_fft2d_plan = fftwf_plan_dft_r2c_2d(height, width, g_fft_input_tmp, g_fft_result, FFTW_MEASURE);
-	g_ifft2d_plan = fftwf_plan_dft_c2r_2d(height, width, g_ifft_input_tmp, g_ifft_result, FFTW_MEASURE);
-    
-    if (!g_fft2d_plan || !g_ifft2d_plan) {
-        cleanup_fftw_resources();
-        return -1;
-    }
-    
-    g_width = width;
-    g_height = height;
-	g_line_length = line_length;
-    g_initialized = 1;
-    
-    return 0;
-}
-
-/**
- * Filtre le spectre de fréquence pour éliminer le moiré spécifique aux écrans Kaleido 3
- * 
- * @param spectrum Spectre FFT complet (modifié sur place)
- * @param width Largeur de l'image
- * @param height Hauteur de l'image
- * @param param_radius_min Rayon minimal pour le filtre passe-bas
- * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
- */
-void filter_spectrum_for_kaleido(fftwf_complex *spectrum, int width, int height, 
-                                float param_radius_min, float param_radius_max_diviser) {
-    
-    float radius_min = param_radius_min;
-    float radius_max = width / param_radius_max_diviser;
-
-    int center_x = width / 2;
-    int center_y = height / 2;
-    
-    float radius_min_squared = radius_min * radius_min;
-    float radius_max_squared = radius_max * radius_max;
-    float radius_diff_inv = 1.0f / (radius_max - radius_min);
-
-    const float PI_2 = PI / 2;
-    const float PI_4 = PI / 4;
-    const float angle_threshold = 0.05f;
-    const float angle_threshold_diag = 0.1f;
-    const float magnitude_threshold = 10000.0f;
-
-    // OpenMP parallèle sur les blocs verticaux
-    #pragma omp parallel for schedule(dynamic)
-    for (int by = 0; by < height; by += BLOCK_HEIGHT) {
-        int block_h = (by + BLOCK_HEIGHT <= height) ? BLOCK_HEIGHT : height - by;
-        
-        for (int bx = 0; bx < width; bx += BLOCK_WIDTH) {
-            int block_w = (bx + BLOCK_WIDTH <= width) ? BLOCK_WIDTH : width - bx;
-
-            if (bx + BLOCK_WIDTH < width) {
-                PREFETCH(&spectrum[2 * (by * width + (bx + BLOCK_WIDTH))]);
-            }
-
-            for (int y = 0; y < block_h; y++) {
-                for (int x = 0; x < block_w; x++) {
-                    int px = bx + x;
-                    int py = by + y;
-                    int idx = py * width + px;
-
-                    float dx = px - center_x;
-                    float dy = py - center_y;
-                    float radius_squared = dx * dx + dy * dy;
-
-                    float attenuation = 1.0f;
-
-                    if (radius_squared > radius_max_squared) {
-                        attenuation = 0.0f;
-                    } else if (radius_squared <= radius_min_squared) {
-                        attenuation = 1.0f;
-                    } else {
-                        float radius = sqrtf(radius_squared);
-                        float angle = atan2f(dy, dx);
-
-                        float real = ((float*)spectrum)[2*idx];
-                        float imag = ((float*)spectrum)[2*idx+1];
-                        float magnitude = sqrtf(real * real + imag * imag);
-
-                        float angle_mod = fmodf(fabsf(angle), PI_2);
-
-                        if ((angle_mod < angle_threshold || angle_mod > PI_2 - angle_threshold) && 
-                            radius_squared > 4 * radius_min_squared) {
-                            attenuation = (magnitude > magnitude_threshold) ? 
-                                0.01f : 1.0f - (radius - radius_min) * radius_diff_inv * 0.5f;
-                        } else if (fabsf(fmodf(fabsf(angle - PI_4), PI_2)) < angle_threshold_diag && 
-                                radius_squared > 4 * radius_min_squared) {
-                            attenuation = 0.3f;
-                        } else {
-                            attenuation = 1.0f - (radius - radius_min) * radius_diff_inv * 0.2f;
-                        }
-                    }
-
-                    ((float*)spectrum)[2*idx] *= attenuation;
-                    ((float*)spectrum)[2*idx+1] *= attenuation;
-                }
-            }
-        }
-    }
-}
-
-/**
- * Applique la FFT 2D à une image en niveaux de gris
- * Implémente l'algorithme de Cooley-Tukey (par lignes puis colonnes)
- * 
- * @param input_data Données de l'image d'entrée
- * @param output_spectrum Spectre de sortie complexe
- * @param width Largeur de l'image
- * @param height Hauteur de l'image
- * @param line_length Longueur de ligne (peut inclure padding)
- */
-void fft2d_grayscale(unsigned char *input_data, fftwf_complex *output_spectrum, 
-                    int width, int height, int line_length) {  
-    // Conversion RGB24 → niveau de gris (luminance)
-    #pragma omp parallel for schedule(static)
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            unsigned char r = input_data[y * line_length + x * 3 + 0];
-            unsigned char g = input_data[y * line_length + x * 3 + 1];
-            unsigned char b = input_data[y * line_length + x * 3 + 2];
-            float gray = (r + g + b)/3;
-            g_fft_input_tmp[y * width + x] = gray;
-        }
-    }
-    
-    // Appliquer la FFT 2D avec le plan préexistant
-    fftwf_execute(g_fft2d_plan);
-    
-    // Copier et centrer le spectre dans output_spectrum avec symétrie hermitienne
-    #pragma omp parallel for schedule(static)
-    for (int y = 0; y < height; y++) {
-        int dst_y = (y + height / 2) % height;
-        for (int x = 0; x < width / 2 + 1; x++) {
-            int dst_x = (x + width / 2) % width;
-            float *out_ptr = (float *)&output_spectrum[dst_y * width + dst_x];
-            float *in_ptr = (float *)&g_fft_result[y * (width / 2 + 1) + x];
-            out_ptr[0] = in_ptr[0];  // Re
-            out_ptr[1] = in_ptr[1];  // Im
-            // Remplir miroir hermitien
-            if (x > 0 && x < width / 2) {
-                int mirror_x = (width - x) % width;
-                int dst_mirror_x = (mirror_x + width / 2) % width;
-                float *mirror_ptr = (float *)&output_spectrum[dst_y * width + dst_mirror_x];
-                mirror_ptr[0] = in_ptr[0];      // Re identique
-                mirror_ptr[1] = -in_ptr[1];     // Im conjuguée
-            }
-        }
-    }
-    // Note: on ne détruit pas le plan ni ne libère la mémoire ici
-}
-
-
-/**
- * Applique la transformée de Fourier inverse 2D pour récupérer l'image
- * 
- * @param input_spectrum Spectre d'entrée complexe
- * @param output_data Données de sortie de l'image
- * @param width Largeur
- * @param height Hauteur
- * @param line_length Longueur de ligne (peut inclure padding)
- */
-void ifft2d_grayscale(fftwf_complex *input_spectrum, unsigned char *output_data,
-                     int width, int height, int line_length) {  
-    // Réorganiser le spectre centré vers le format attendu par FFTW pour c2r
-    #pragma omp parallel for schedule(static)
-    for (int y = 0; y < height; y++) {
-        int dst_y = y;
-        int src_y = (y + height/2) % height;
-        
-        for (int x = 0; x < width/2 + 1; x++) {
-            int src_x = (x + width/2) % width;
-            
-            // Accès correct au format interleaved
-            float *out_ptr = (float *)&g_ifft_input_tmp[dst_y * (width/2 + 1) + x];
-            float *in_ptr = (float *)&input_spectrum[src_y * width + src_x];
-            
-            out_ptr[0] = in_ptr[0];  // Partie réelle
-            out_ptr[1] = in_ptr[1];  // Partie imaginaire
-        }
-    }
-	
-	// Appliquer la IFFT 2D avec le plan préexistant
-    fftwf_execute(g_ifft2d_plan);
-    
-    // Normaliser et convertir les résultats en RGB (image en niveaux de gris)
-    float norm_factor = 1.0f / (width * height);
-
-    #pragma omp parallel for schedule(static)
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            // Normaliser
-            float pixel_value = g_ifft_result[y * width + x] * norm_factor;
-            
-            // Limiter les valeurs entre 0 et 255
-            int pixel_int = (int)pixel_value;
-            pixel_int = (pixel_int < 0) ? 0 : ((pixel_int > 255) ? 255 : pixel_int);
-            
-            // Écrire la valeur dans les 3 canaux RGB
-            output_data[y * line_length + x * 3] = (unsigned char)pixel_int;
-            output_data[y * line_length + x * 3 + 1] = (unsigned char)pixel_int;
-            output_data[y * line_length + x * 3 + 2] = (unsigned char)pixel_int;
-        }
-    }
-    // Note: on ne détruit pas le plan ni ne libère la mémoire ici
-}
-
-/**
- * Fonction principale pour supprimer le moiré
- * 
- * @param fb_data Données du framebuffer d'entrée (modifiées sur place)
- * @param width Largeur de l'image
- * @param height Hauteur de l'image
- * @param line_length Longueur de ligne du framebuffer
- * @param param_radius_min Rayon minimal pour le filtre passe-bas
- * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
- */
-EXPORT void remove_moire(unsigned char *fb_data, int width, int height, int line_length,
-                 float param_radius_min, float param_radius_max_diviser) {
-    // Initialiser ou réutiliser les ressources FFTW
-    if (init_fftw_resources(width, height, line_length) != 0) {
-        fprintf(stderr, "Erreur d'initialisation des ressources FFTW\n");
-        return;
-    }
-    
-    // Allouer mémoire alignée pour le spectre FFT
-    fftwf_complex *fft_spectrum = fftwf_malloc(sizeof(fftwf_complex) * width * height);
-    
-    // Appliquer la FFT 2D
-    fft2d_grayscale(fb_data, fft_spectrum, width, height, line_length);
-    
-    // Filtrer le spectre pour éliminer le moiré
-    filter_spectrum_for_kaleido(fft_spectrum, width, height, param_radius_min, param_radius_max_diviser);
-    
-    // Appliquer l'IFFT 2D
-	ifft2d_grayscale(fft_spectrum, fb_data, width, height, line_length);
-    
-    
-    // Libérer la mémoire temporaire
-    fftwf_free(fft_spectrum);
-    
-}
-
-EXPORT int init_moire_resources() {
-    // Initialisation des threads FFTW une seule fois
-    fftwf_init_threads();
-    fftwf_plan_with_nthreads(omp_get_max_threads());
-    return 0;
-}
-
-EXPORT void cleanup_moire_resources() {
-    cleanup_fftw_resources();
-    fftwf_cleanup_threads();
-    fftwf_cleanup();
-}
\ No newline at end of file
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+#include <pthread.h>
+#include "fftw3.h"
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef __GNUC__
+#define EXPORT __attribute__((visibility("default")))
+#else
+#define EXPORT
+#endif
+
+
+#define PI 3.14159265358979323846f
+
+// Traitement par rectangle (rafraîchissements partiels)
+#define RECT_GUARD_MARGIN 16        // Marge de contexte autour du rectangle (pixels)
+#define RECT_MIN_SIZE 64            // Plus petite classe de taille de fenêtre
+#define RECT_PLAN_CACHE_SIZE 4      // Nombre de jeux de plans conservés pour les rectangles
+#define RECT_FULL_FRAME_RATIO 0.5f  // Au-delà de cette fraction de l'écran, on traite l'écran entier
+
+// Géométries d'écran gardées planifiées (portrait et paysage)
+#define SCREEN_CACHE_SIZE 2
+
+// Cache des pages filtrées (pages revues, retours en arrière)
+#define PAGE_CACHE_MAX_ENTRIES 32   // Nombre maximal de pages conservées, quel que soit le budget
+
+// Bourrage du plan de luminance jusqu'à une taille favorable à la FFT (2^a·3^b·5^c·7^d)
+#define MOIRE_PAD_NONE 0        // Transformée à la taille exacte de l'image
+#define MOIRE_PAD_MIRROR 1      // Bords en miroir (limite les oscillations aux bords de l'écran)
+#define MOIRE_PAD_REPLICATE 2   // Répétition du pixel de bord
+#define MOIRE_PAD_ZERO 3        // Bords à zéro
+
+// Résultats des fonctions de filtrage
+#define MOIRE_FILTERED 0        // Moiré supprimé
+#define MOIRE_COLORED 1         // Image en couleur, laissée intacte
+#define MOIRE_UNCHANGED 2       // Image identique à la dernière sortie enregistrée, rien à faire
+#define MOIRE_PENDING 3         // Filtrage asynchrone encore en cours
+#define MOIRE_STALE 4           // L'écran a changé pendant le filtrage asynchrone : résultat abandonné
+#define MOIRE_SKIPPED 5         // Filtrage volontairement omis, framebuffer intact
+
+// Niveaux de qualité d'un filtrage de rectangle (remove_moire_rect_quality)
+#define MOIRE_QUALITY_FULL 0    // Pleine résolution
+#define MOIRE_QUALITY_REDUCED 1 // FFT sur la luminance réduite, puis interpolée (brouillon)
+#define MOIRE_QUALITY_BYPASS 2  // Aucun filtrage
+#define REDUCED_FACTOR 2        // Facteur de réduction du niveau MOIRE_QUALITY_REDUCED
+#define MOIRE_DECIMATION_MAX 4  // Facteur de décimation maximal (set_moire_decimation)
+
+// États du filtrage asynchrone
+#define ASYNC_IDLE 0            // Aucun résultat attendu
+#define ASYNC_RUNNING 1         // Demande en attente ou en cours de filtrage
+#define ASYNC_DONE 2            // Résultat prêt à être recopié dans le framebuffer
+
+// Empreintes de la dernière image produite (détection des rafraîchissements redondants)
+#define FRAME_HASH_TILE 64      // Côté des tuiles hachées (pixels)
+
+// Sonde d'énergie spectrale (omission du filtrage des pages sans moiré)
+#define PROBE_TILE_SIZE 32      // Côté des tuiles analysées (pixels)
+#define PROBE_GRID 5            // Tuiles analysées par dimension de l'écran (PROBE_GRID² en tout)
+#define PROBE_GUARD_BINS 2.0f   // Marge au-delà du rayon maximal (lobe principal de la fenêtre de Hann)
+
+// Mode incrémental : seules les tuiles modifiées sont refiltrées
+#define TILE_CLEAN 0            // Tuile identique à la dernière sortie
+#define TILE_RESTORE 1          // Tuile identique à la dernière source : sortie reprise du cache
+#define TILE_DIRTY 2            // Nouveau contenu à filtrer
+#define INCREMENTAL_HALO_LOBES 8    // Halo autour des tuiles modifiées, en périodes de coupure du filtre
+#define INCREMENTAL_HALO_MAX 64     // Halo maximal (pixels)
+
+// Étapes chronométrées du dernier filtrage (get_moire_timings)
+#define MOIRE_STAGE_LOAD 0      // Conversion en luminance et bourrage
+#define MOIRE_STAGE_FFT 1       // FFT directe
+#define MOIRE_STAGE_FILTER 2    // Filtrage du spectre
+#define MOIRE_STAGE_IFFT 3      // FFT inverse
+#define MOIRE_STAGE_STORE 4     // Normalisation et écriture RGB24
+#define MOIRE_STAGE_TOTAL 5     // Filtrage complet
+#define MOIRE_STAGE_COUNT 6
+
+// Moteurs de filtrage de l'écran complet
+#define MOIRE_ENGINE_FULL 0     // Une seule transformée de l'écran entier
+#define MOIRE_ENGINE_TILED 1    // Tuiles fenêtrées recouvrantes à 50 % (overlap-add)
+#define MOIRE_ENGINE_SPATIAL 2  // Convolution séparable sans FFT (configuration passe-bas uniquement)
+#define TILED_MIN_SIZE 64       // Côtés de tuile acceptés : puissances de 2 de 64 à 512
+#define TILED_MAX_SIZE 512
+#define TILED_DEFAULT_SIZE 256
+#define SPATIAL_KERNEL_RADIUS 16    // Demi-longueur des noyaux du moteur spatial (33 coefficients)
+
+/**
+ * Masque d'atténuation précalculé pour une géométrie et des paramètres de filtre
+ *
+ * Tout ce qui ne dépend que de la position de la fréquence (rayon, angle) est calculé
+ * une seule fois. Seules les cases proches des axes dépendent encore de l'amplitude
+ * du spectre : elles sont listées à part, ligne par ligne, avec leur atténuation
+ * quand l'amplitude reste sous le seuil.
+ */
+typedef struct {
+    float *attenuation;         // height * (width/2 + 1) coefficients (1 pour les cases axiales)
+    int *axis_index;            // Index des cases axiales dans le demi-spectre, triés par ligne
+    float *axis_ramp;           // Atténuation des cases axiales sous le seuil d'amplitude
+    int *axis_row_start;        // Première case axiale de chaque ligne (height + 1 entrées)
+    int axis_count;
+    float magnitude_threshold;
+
+    // Clé du masque
+    int width;
+    int height;
+    int ref_width;
+    int ref_height;
+    float radius_min;
+    float radius_max_diviser;
+
+    size_t bytes;               // Mémoire occupée par le masque
+} filter_mask;
+
+/**
+ * Plans FFTW et buffers de travail pour une taille de transformée donnée
+ * L'image (image_width x image_height) occupe le coin haut gauche de la transformée
+ * (width x height) ; le reste est rempli selon pad_mode.
+ *
+ * En mode économe (lean), un seul buffer de height * 2 * (width/2 + 1) floats sert aux
+ * deux transformées, faites sur place : fft_input_tmp, fft_result et ifft_result
+ * pointent alors sur la même mémoire et les lignes du plan réel font
+ * 2 * (width/2 + 1) floats (real_stride).
+ */
+typedef struct {
+    fftwf_plan fft2d_plan;
+    float *fft_input_tmp;
+    fftwf_complex *fft_result;
+
+    fftwf_plan ifft2d_plan;     // Lit directement le demi-spectre filtré (fft_result)
+    float *ifft_result;
+
+    int lean;                   // Transformées sur place dans un buffer unique
+    int real_stride;            // Longueur (en floats) d'une ligne des plans réels
+    size_t bytes;               // Mémoire des buffers de travail
+
+    filter_mask mask;           // Masque du filtre, reconstruit si la géométrie ou les paramètres changent
+
+    int width;
+    int height;
+    int image_width;
+    int image_height;
+    int pad_mode;
+    unsigned int last_use;  // Horodatage LRU (cache des rectangles)
+    double *stage_ms;       // Durées des étapes du dernier filtrage (g_stage_ms ou celles d'un contexte)
+} fftw_resources;
+
+/**
+ * Contexte de filtrage de l'écran complet pour une géométrie donnée
+ *
+ * Un contexte ne partage avec les autres que le planificateur FFTW (protégé) et la
+ * comptabilité mémoire : des contextes différents peuvent filtrer en même temps depuis
+ * des threads différents, un seul appel à la fois par contexte. Les fonctions
+ * historiques (remove_moire...) utilisent un cache LRU de SCREEN_CACHE_SIZE contextes
+ * et restent réservées à un seul thread (empreintes, caches, rectangles).
+ */
+typedef struct moire_ctx {
+    fftw_resources full;        // Plans et buffers de l'écran complet
+    int line_length;
+    double stage_ms[MOIRE_STAGE_COUNT];
+    unsigned int last_use;      // Horodatage LRU (cache des géométries d'écran)
+} moire_ctx;
+
+// Tuiles de l'image à laisser intactes à l'écriture (tuiles colorées d'une page mixte)
+typedef struct {
+    const unsigned char *tiles;  // 1 octet par tuile, ligne par ligne ; non nul : tuile laissée intacte
+    int tile_size;               // Côté des tuiles en pixels
+    int tiles_x;                 // Nombre de tuiles par ligne
+} output_mask;
+
+// Luminance 8 bits lue ou copiée par une fenêtre (caches du mode incrémental)
+// Les pointeurs désignent le premier pixel de la fenêtre ; NULL : non utilisé
+typedef struct {
+    const unsigned char *gray;   // Luminance source à lire à la place du framebuffer RGB24
+    unsigned char *gray_copy;    // Copie de la luminance source lue
+    unsigned char *out_copy;     // Copie de la luminance écrite dans le framebuffer
+    int stride;                  // Pas des lignes de ces trois plans
+} luma_io;
+
+// Empreintes par tuile de la dernière image produite
+typedef struct {
+    uint32_t *hashes;            // Empreinte de chaque tuile, ligne par ligne
+    unsigned char *valid;        // Tuile identique à la dernière sortie enregistrée
+    int width, height, line_length;
+    int tiles_x, tiles_y;
+    int rect_x, rect_y, rect_w, rect_h;  // Dernier rectangle filtré (rect_w nul : aucun)
+    uint32_t rect_hash;                  // Empreinte exacte de ce rectangle après écriture
+} frame_hashes;
+
+// Dernière image source et filtrée du mode incrémental (luminance 8 bits, une tuile
+// de FRAME_HASH_TILE pixels de côté par entrée des tableaux par tuile)
+typedef struct {
+    unsigned char *source;       // Luminance de la source (avant filtrage)
+    unsigned char *filtered;     // Luminance écrite dans le framebuffer
+    uint32_t *source_hashes;     // Empreinte RGB24 de chaque tuile source
+    uint32_t *incoming_hashes;   // Empreintes des tuiles reçues lors de l'appel en cours
+    unsigned char *source_valid; // Cache source et sortie cohérents pour la tuile
+    unsigned char *state;        // Classement des tuiles lors de l'appel en cours (TILE_*)
+    int width, height, line_length;
+    int gray_frame;              // Dernière image entièrement produite par le filtre
+    size_t bytes;
+} frame_cache;
+
+/**
+ * Moteur par tuiles : l'écran est découpé en tuiles de N x N pixels espacées de N/2,
+ * pondérées par une fenêtre racine de Hann à l'analyse comme à la synthèse (la somme
+ * des carrés des fenêtres recouvrantes vaut 1). Les tuiles sont traitées rangée par
+ * rangée : seules N lignes de luminance et N lignes d'accumulation sont en mémoire,
+ * et chaque thread transforme ses tuiles dans son propre buffer avec un plan unique.
+ */
+typedef struct {
+    fftw_resources plans;       // Plans N x N sur place, mono-thread, et buffer du premier thread
+    float **tile_buffers;       // Buffer de tuile de chaque thread (le premier est plans.fft_input_tmp)
+    int thread_count;
+    float *window;              // Fenêtre racine de Hann (N coefficients)
+    float *strip;               // N lignes de luminance de la rangée de tuiles en cours, bords en miroir
+    float *accum;               // N lignes d'accumulation des tuiles synthétisées
+    unsigned char *reserve;     // Luminance des N dernières lignes, relues en miroir après leur écriture
+    int strip_stride;           // Longueur des lignes de strip et accum (image et marges de N/2)
+    int image_width, image_height;
+    size_t bytes;               // Mémoire hors plans (buffers des autres threads, lignes)
+} tiled_engine;
+
+/**
+ * Brouillons : tuiles écrites en qualité réduite, dont la source est gardée pour que le
+ * filtrage pleine qualité suivant reparte de l'image d'origine et non du brouillon
+ */
+typedef struct {
+    unsigned char *source;      // Luminance source 8 bits des tuiles en brouillon (écran complet)
+    uint32_t *hashes;           // Empreinte du brouillon écrit dans chaque tuile
+    unsigned char *valid;       // Tuile en brouillon
+    int width;
+    int height;
+    int line_length;
+    int tiles_x;
+    int tiles_y;
+    int count;                  // Nombre de tuiles en brouillon
+    size_t bytes;
+} draft_frame;
+
+/**
+ * Page filtrée conservée par le cache des pages
+ * La clé couvre tout ce qui détermine la sortie : source, géométrie, détection de
+ * couleur, paramètres du filtre, moteur, décimation et bourrage.
+ */
+typedef struct {
+    uint64_t source_hash;       // Empreinte de l'écran source (hash_frame)
+    int width;
+    int height;
+    int tolerance;              // Tolérance de détection de couleur (-1 : aucune détection)
+    float radius_min;
+    float radius_max_diviser;
+    int engine;
+    int tile_size;
+    int decimation;
+    int pad_mode;
+    int result;                 // MOIRE_FILTERED ou MOIRE_COLORED
+    unsigned char *gray;        // Sortie en niveaux de gris 8 bits (NULL pour une page en couleur)
+    size_t bytes;
+    unsigned int last_use;      // Horodatage LRU, 0 : entrée libre
+} page_entry;
+
+typedef struct {
+    page_entry entries[PAGE_CACHE_MAX_ENTRIES];
+    size_t budget;              // Mémoire maximale des sorties conservées (0 : cache désactivé)
+    size_t bytes;
+    unsigned int clock;
+    size_t hits;
+    size_t misses;
+} page_cache;
+
+/**
+ * Copie de l'écran confiée au thread de fond (filtrée sur place)
+ */
+typedef struct {
+    unsigned char *data;
+    size_t bytes;               // Taille allouée
+    int width;
+    int height;
+    int line_length;
+    int tolerance;
+    float radius_min;
+    float radius_max_diviser;
+    uint32_t source_hash;       // Empreinte de l'écran avant filtrage
+    double stage_ms[MOIRE_STAGE_COUNT];     // Durées des étapes de son filtrage
+} async_frame;
+
+/**
+ * Thread de fond du filtrage asynchrone
+ *
+ * Le thread de l'interface dépose une copie de l'écran dans pending et repart aussitôt ;
+ * le thread de fond l'échange avec active et la filtre dans son propre contexte. Une
+ * nouvelle demande remplace la précédente et rend obsolète celle en cours. Le résultat
+ * n'est recopié dans le framebuffer que par moire_async_poll(), depuis le thread de
+ * l'interface, si l'écran n'a pas changé entre-temps.
+ *
+ * Le préfiltrage (moire_prefilter_start) passe par le même thread, après les demandes
+ * asynchrones : prefetch_pending est échangé avec prefetch_work pendant le filtrage,
+ * puis prefetch_work avec prefetch_ready, qui garde le dernier résultat terminé.
+ */
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int started;                // Thread de fond lancé
+    int quit;                   // Arrêt demandé (cleanup_moire_resources)
+    int has_pending;            // pending contient une demande pas encore prise en charge
+    int busy;                   // active en cours de filtrage
+    int cancelled;              // Résultat de active devenu obsolète
+    int state;                  // ASYNC_*
+    int result;                 // Code de moire_ctx_process() pour active
+    async_frame pending;
+    async_frame active;
+    int has_prefetch;           // prefetch_pending contient une demande de préfiltrage
+    int prefetch_result;        // Code de moire_ctx_process() pour prefetch_ready, -1 : aucun résultat
+    async_frame prefetch_pending;
+    async_frame prefetch_work;
+    async_frame prefetch_ready;
+    moire_ctx *ctx;             // Contexte du thread de fond (recréé si la géométrie change)
+} async_worker;
+
+// Variables globales pour les plans FFT et les buffers
+static moire_ctx g_screens[SCREEN_CACHE_SIZE];
+static moire_ctx *g_screen = NULL;   // Géométrie du dernier filtrage de l'écran complet
+static unsigned int g_screen_clock = 0;
+static frame_hashes g_frame;
+static frame_cache g_cache;
+static page_cache g_pages;
+static draft_frame g_draft;
+static int g_incremental_mode = 0;
+static tiled_engine g_tiled;
+static int g_engine = MOIRE_ENGINE_FULL;
+static int g_tile_fft_size = TILED_DEFAULT_SIZE;
+static int g_decimation = 1;         // Facteur de décimation du moteur complet (1 : pleine résolution)
+static int g_pad_mode = MOIRE_PAD_NONE;
+static int g_lean_mode = 0;
+
+// Durée des étapes du dernier filtrage, en millisecondes
+static double g_stage_ms[MOIRE_STAGE_COUNT];
+
+// Omission du filtrage de l'écran complet selon la sonde (0 : toujours filtrer)
+static float g_skip_threshold = 0.0f;
+static double g_probe_score = -1.0;  // Score de la dernière sonde de l'écran complet (-1 : aucune)
+static int g_probe_skipped = 0;      // Dernier écran complet laissé tel quel par la sonde
+
+// Mémoire allouée par la bibliothèque (buffers FFT et masques)
+static size_t g_bytes_current = 0;
+static size_t g_bytes_peak = 0;
+
+// Support multi-thread de FFTW initialisé (planificateur protégé pour les contextes)
+static int g_fftw_threads = 0;
+
+// Filtrage asynchrone des rafraîchissements complets
+static async_worker g_async = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER,
+                                .prefetch_result = -1 };
+
+// Plans conservés par classe de taille de rectangle
+static fftw_resources g_rect_plans[RECT_PLAN_CACHE_SIZE];
+static unsigned int g_rect_clock = 0;
+
+// Sagesse FFTW (wisdom) persistée entre les sessions
+static char g_wisdom_path[512] = "";
+static int g_wisdom_loaded = 0;   // Sagesse présente dans le planificateur (oubliée par fftwf_cleanup)
+static int g_wisdom_dirty = 0;    // Nouveaux plans depuis la dernière sauvegarde
+
+/**
+ * Comptabilise une allocation (suivi de la mémoire courante et du pic)
+ */
+static void account_alloc(size_t bytes) {
+    #pragma omp critical(moire_bytes)
+    {
+        g_bytes_current += bytes;
+        if (g_bytes_current > g_bytes_peak) {
+            g_bytes_peak = g_bytes_current;
+        }
+    }
+}
+
+/**
+ * Comptabilise une libération
+ */
+static void account_free(size_t bytes) {
+    #pragma omp critical(moire_bytes)
+    g_bytes_current -= bytes;
+}
+
+/**
+ * Libère un masque de filtre
+ */
+static void release_filter_mask(filter_mask *mask) {
+    account_free(mask->bytes);
+    fftwf_free(mask->attenuation);
+    free(mask->axis_index);
+    free(mask->axis_ramp);
+    free(mask->axis_row_start);
+    memset(mask, 0, sizeof(*mask));
+}
+
+/**
+ * Libère les buffers de travail et le masque d'un jeu de ressources en gardant ses plans
+ * (les plans restent utilisables avec de nouveaux buffers, voir allocate_fftw_buffers)
+ */
+static void release_fftw_buffers(fftw_resources *res) {
+    // En mode économe, les trois pointeurs désignent le même buffer
+    if (res->fft_input_tmp) {
+        fftwf_free(res->fft_input_tmp);
+    }
+
+    if (res->fft_result && (void *)res->fft_result != (void *)res->fft_input_tmp) {
+        fftwf_free(res->fft_result);
+    }
+
+    if (res->ifft_result && res->ifft_result != res->fft_input_tmp) {
+        fftwf_free(res->ifft_result);
+    }
+
+    res->fft_input_tmp = NULL;
+    res->fft_result = NULL;
+    res->ifft_result = NULL;
+
+    account_free(res->bytes);
+    res->bytes = 0;
+    release_filter_mask(&res->mask);
+}
+
+/**
+ * Libère les plans et buffers d'un jeu de ressources
+ */
+static void release_fftw_resources(fftw_resources *res) {
+    if (res->fft2d_plan) {
+        fftwf_destroy_plan(res->fft2d_plan);
+    }
+
+    if (res->ifft2d_plan) {
+        fftwf_destroy_plan(res->ifft2d_plan);
+    }
+
+    release_fftw_buffers(res);
+    memset(res, 0, sizeof(*res));
+}
+
+/**
+ * Libère les empreintes de la dernière image
+ */
+static void release_frame_hashes() {
+    if (g_frame.hashes) {
+        account_free(sizeof(uint32_t) * g_frame.tiles_x * g_frame.tiles_y);
+        free(g_frame.hashes);
+    }
+    if (g_frame.valid) {
+        account_free(g_frame.tiles_x * g_frame.tiles_y);
+        free(g_frame.valid);
+    }
+    memset(&g_frame, 0, sizeof(g_frame));
+}
+
+/**
+ * Libère les caches du mode incrémental
+ */
+static void release_frame_cache() {
+    free(g_cache.source);
+    free(g_cache.filtered);
+    free(g_cache.source_hashes);
+    free(g_cache.incoming_hashes);
+    free(g_cache.source_valid);
+    free(g_cache.state);
+    account_free(g_cache.bytes);
+    memset(&g_cache, 0, sizeof(g_cache));
+}
+
+/**
+ * Libère les lignes et les buffers de tuile du moteur par tuiles en gardant ses plans
+ */
+static void release_tiled_buffers() {
+    for (int i = 1; i < g_tiled.thread_count; i++) {
+        fftwf_free(g_tiled.tile_buffers[i]);
+    }
+    free(g_tiled.tile_buffers);
+    free(g_tiled.window);
+    free(g_tiled.strip);
+    free(g_tiled.accum);
+    free(g_tiled.reserve);
+    account_free(g_tiled.bytes);
+    release_fftw_buffers(&g_tiled.plans);
+
+    g_tiled.tile_buffers = NULL;
+    g_tiled.thread_count = 0;
+    g_tiled.window = g_tiled.strip = g_tiled.accum = NULL;
+    g_tiled.reserve = NULL;
+    g_tiled.bytes = 0;
+}
+
+/**
+ * Libère le moteur par tuiles (plans compris)
+ */
+static void release_tiled_engine() {
+    release_tiled_buffers();
+    release_fftw_resources(&g_tiled.plans);
+    memset(&g_tiled, 0, sizeof(g_tiled));
+}
+
+/**
+ * Prépare les empreintes pour la géométrie du framebuffer
+ * (toutes les tuiles sont invalidées si elle change)
+ * @return 0 en cas de succès, -1 en cas d'erreur d'allocation
+ */
+static int prepare_frame_hashes(int width, int height, int line_length) {
+    if (g_frame.hashes && g_frame.width == width && g_frame.height == height &&
+        g_frame.line_length == line_length) {
+        return 0;
+    }
+
+    release_frame_hashes();
+    int tiles_x = (width + FRAME_HASH_TILE - 1) / FRAME_HASH_TILE;
+    int tiles_y = (height + FRAME_HASH_TILE - 1) / FRAME_HASH_TILE;
+    g_frame.hashes = malloc(sizeof(uint32_t) * tiles_x * tiles_y);
+    g_frame.valid = calloc(tiles_x * tiles_y, 1);
+    if (!g_frame.hashes || !g_frame.valid) {
+        free(g_frame.hashes);
+        free(g_frame.valid);
+        memset(&g_frame, 0, sizeof(g_frame));
+        return -1;
+    }
+    account_alloc(sizeof(uint32_t) * tiles_x * tiles_y + tiles_x * tiles_y);
+
+    g_frame.width = width;
+    g_frame.height = height;
+    g_frame.line_length = line_length;
+    g_frame.tiles_x = tiles_x;
+    g_frame.tiles_y = tiles_y;
+    return 0;
+}
+
+/**
+ * Alloue les buffers de travail d'un jeu de ressources (res->width, res->height et
+ * res->lean déjà renseignés). fftwf_malloc garantit l'alignement SIMD attendu par
+ * les plans, qui peuvent donc être exécutés sur ces nouveaux buffers.
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+static int allocate_fftw_buffers(fftw_resources *res) {
+    int width = res->width;
+    int height = res->height;
+    int half_width = width / 2 + 1;
+
+    if (res->lean) {
+        res->fft_input_tmp = fftwf_malloc(sizeof(float) * height * 2 * half_width);
+        res->fft_result = (fftwf_complex *)res->fft_input_tmp;
+        res->ifft_result = res->fft_input_tmp;
+        res->real_stride = 2 * half_width;
+        res->bytes = sizeof(float) * height * 2 * half_width;
+    } else {
+        res->fft_input_tmp = fftwf_malloc(sizeof(float) * width * height);
+        res->fft_result = fftwf_malloc(sizeof(fftwf_complex) * height * half_width);
+        res->ifft_result = fftwf_malloc(sizeof(float) * width * height);
+        res->real_stride = width;
+        res->bytes = sizeof(float) * width * height * 2 + sizeof(fftwf_complex) * height * half_width;
+    }
+
+    if (!res->fft_input_tmp || !res->fft_result || !res->ifft_result) {
+        res->bytes = 0;
+        release_fftw_buffers(res);
+        return -1;
+    }
+    account_alloc(res->bytes);
+    return 0;
+}
+
+/**
+ * Recharge la sagesse FFTW depuis le fichier configuré si le planificateur l'a oubliée
+ */
+static void ensure_wisdom_loaded() {
+    if (g_wisdom_path[0] && !g_wisdom_loaded) {
+        g_wisdom_loaded = fftwf_import_wisdom_from_filename(g_wisdom_path);
+    }
+}
+
+/**
+ * Initialise une seule fois le support multi-thread de FFTW et rend le planificateur
+ * utilisable depuis plusieurs threads (contextes filtrés en parallèle)
+ */
+static void ensure_fftw_threads() {
+    #pragma omp critical(moire_planner)
+    {
+        if (!g_fftw_threads) {
+            fftwf_init_threads();
+            fftwf_make_planner_thread_safe();
+            g_fftw_threads = 1;
+        }
+    }
+}
+
+/**
+ * Plus petite taille >= size de la forme 2^a·3^b·5^c·7^d, pour laquelle FFTW dispose
+ * de codelets rapides (1264 = 16·79 devient par exemple 1280 = 2^8·5)
+ */
+static int fft_friendly_size(int size) {
+    for (int n = size; ; n++) {
+        int m = n;
+        while (m % 2 == 0) m /= 2;
+        while (m % 3 == 0) m /= 3;
+        while (m % 5 == 0) m /= 5;
+        while (m % 7 == 0) m /= 7;
+        if (m == 1) {
+            return n;
+        }
+    }
+}
+
+/**
+ * Alloue les buffers et crée les plans FFT pour une taille d'image donnée
+ * @param image_width Largeur de l'image traitée
+ * @param image_height Hauteur de l'image traitée
+ * @param pad_mode Bourrage jusqu'à une taille favorable (MOIRE_PAD_*)
+ * @param lean Buffer unique et transformées sur place
+ * @param nthreads Nombre de threads des plans
+ * @param planner_flags Rigueur du planificateur (FFTW_MEASURE en usage normal)
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+static int create_fftw_resources(fftw_resources *res, int image_width, int image_height, int pad_mode,
+                                 int lean, int nthreads, unsigned planner_flags) {
+    int width = (pad_mode != MOIRE_PAD_NONE) ? fft_friendly_size(image_width) : image_width;
+    int height = (pad_mode != MOIRE_PAD_NONE) ? fft_friendly_size(image_height) : image_height;
+
+    res->width = width;
+    res->height = height;
+    res->image_width = image_width;
+    res->image_height = image_height;
+    res->pad_mode = pad_mode;
+    res->lean = lean;
+    res->stage_ms = g_stage_ms;
+
+    // Allouer la mémoire
+    if (allocate_fftw_buffers(res) != 0) {
+        memset(res, 0, sizeof(*res));
+        return -1;
+    }
+
+    // Créer les plans FFT (le spectre est filtré sur place entre les deux transformées)
+    // Avec une sagesse chargée, la planification se réduit à une recherche dans la sagesse
+    ensure_fftw_threads();
+    #pragma omp critical(moire_planner)
+    {
+        ensure_wisdom_loaded();
+        fftwf_plan_with_nthreads(nthreads);
+        res->fft2d_plan = fftwf_plan_dft_r2c_2d(height, width, res->fft_input_tmp, res->fft_result, planner_flags);
+        res->ifft2d_plan = fftwf_plan_dft_c2r_2d(height, width, res->fft_result, res->ifft_result, planner_flags);
+        g_wisdom_dirty = 1;
+    }
+
+    if (!res->fft2d_plan || !res->ifft2d_plan) {
+        release_fftw_resources(res);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Prépare un contexte pour une géométrie d'écran (plans créés, buffers alloués)
+ * @param stage_ms Destination des durées des étapes (celles du contexte, ou g_stage_ms)
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+static int init_moire_ctx(moire_ctx *ctx, int width, int height, int line_length, int pad_mode,
+                          double *stage_ms) {
+    memset(ctx, 0, sizeof(*ctx));
+    if (create_fftw_resources(&ctx->full, width, height, pad_mode, g_lean_mode,
+                              omp_get_max_threads(), FFTW_MEASURE) != 0) {
+        return -1;
+    }
+    ctx->full.stage_ms = stage_ms ? stage_ms : ctx->stage_ms;
+    ctx->line_length = line_length;
+    return 0;
+}
+
+/**
+ * Libère les géométries d'écran du cache des fonctions historiques
+ */
+static void release_screen_contexts() {
+    for (int i = 0; i < SCREEN_CACHE_SIZE; i++) {
+        release_fftw_resources(&g_screens[i].full);
+        memset(&g_screens[i], 0, sizeof(g_screens[i]));
+    }
+    g_screen = NULL;
+    g_screen_clock = 0;
+}
+
+/**
+ * Libère les ressources FFTW
+ */
+void cleanup_fftw_resources() {
+    release_screen_contexts();
+    release_frame_hashes();
+    release_frame_cache();
+    release_tiled_engine();
+
+    for (int i = 0; i < RECT_PLAN_CACHE_SIZE; i++) {
+        release_fftw_resources(&g_rect_plans[i]);
+    }
+    g_rect_clock = 0;
+}
+
+/**
+ * Sélectionne (g_screen) le contexte de la géométrie d'écran, en le créant si besoin
+ * Les géométries déjà vues gardent leurs plans : après une rotation, le retour à
+ * l'orientation précédente ne demande aucune planification. Seul le contexte
+ * sélectionné garde ses buffers de travail.
+ * @param width Largeur de l'image
+ * @param height Hauteur de l'image
+ * @param pad_mode Bourrage jusqu'à une taille favorable à la FFT (MOIRE_PAD_*)
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+int init_fftw_resources(int width, int height, int line_length, int pad_mode) {
+    moire_ctx *found = NULL;
+    moire_ctx *victim = &g_screens[0];
+
+    for (int i = 0; i < SCREEN_CACHE_SIZE; i++) {
+        moire_ctx *ctx = &g_screens[i];
+        if (ctx->full.fft2d_plan && ctx->full.image_width == width && ctx->full.image_height == height &&
+            ctx->full.pad_mode == pad_mode && ctx->full.lean == g_lean_mode && ctx->line_length == line_length) {
+            found = ctx;
+            break;
+        }
+        if (ctx->last_use < victim->last_use) {
+            victim = ctx;
+        }
+    }
+
+    if (!found) {
+        // Remplacer la géométrie la moins récemment utilisée (les plans des rectangles restent valides)
+        release_fftw_resources(&victim->full);
+        if (init_moire_ctx(victim, width, height, line_length, pad_mode, g_stage_ms) != 0) {
+            memset(victim, 0, sizeof(*victim));
+            g_screen = NULL;
+            return -1;
+        }
+        found = victim;
+    }
+
+    // Les autres géométries ne gardent que leurs plans
+    for (int i = 0; i < SCREEN_CACHE_SIZE; i++) {
+        if (&g_screens[i] != found) {
+            release_fftw_buffers(&g_screens[i].full);
+        }
+    }
+
+    found->last_use = ++g_screen_clock;
+    g_screen = found;
+    return 0;
+}
+
+/**
+ * Arrondit une dimension de fenêtre à sa classe de taille (64, 96, 128, 192, 256...),
+ * ce qui limite le nombre de plans différents et garde des tailles favorables à la FFT
+ * @param needed Taille minimale requise
+ * @param limit Taille de l'écran dans cette dimension
+ */
+static int rect_size_class(int needed, int limit) {
+    int size = RECT_MIN_SIZE;
+    while (size < needed) {
+        // Alterner entre 2^n et 3·2^(n-1)
+        size = ((size & (size - 1)) == 0) ? size + size / 2 : size * 4 / 3;
+    }
+    return (size < limit) ? size : limit;
+}
+
+/**
+ * Retourne les plans d'une classe de taille de rectangle, en les créant si besoin
+ * (la classe la moins récemment utilisée est remplacée)
+ * @return NULL en cas d'erreur
+ */
+static fftw_resources *acquire_rect_resources(int width, int height, int pad_mode) {
+    fftw_resources *victim = &g_rect_plans[0];
+
+    for (int i = 0; i < RECT_PLAN_CACHE_SIZE; i++) {
+        fftw_resources *res = &g_rect_plans[i];
+        if (res->image_width == width && res->image_height == height && res->pad_mode == pad_mode &&
+            res->lean == g_lean_mode) {
+            res->last_use = ++g_rect_clock;
+            return res;
+        }
+        if (res->last_use < victim->last_use) {
+            victim = res;
+        }
+    }
+
+    release_fftw_resources(victim);
+    if (create_fftw_resources(victim, width, height, pad_mode, g_lean_mode,
+                              omp_get_max_threads(), FFTW_MEASURE) != 0) {
+        return NULL;
+    }
+    victim->last_use = ++g_rect_clock;
+    return victim;
+}
+
+/**
+ * Construit le masque d'atténuation du filtre anti-moiré des écrans Kaleido 3
+ *
+ * Le masque suit le format natif r2c de FFTW (height lignes de width/2 + 1 fréquences).
+ * Chaque case est repérée par sa fréquence signée, ce qui évite de recentrer le
+ * spectre et de reconstruire sa moitié hermitienne.
+ *
+ * Les rayons sont exprimés en fréquences de l'image de référence (l'écran entier) :
+ * pour une fenêtre plus petite, les coordonnées fréquentielles sont ramenées à
+ * l'échelle de la référence afin de couper les mêmes fréquences spatiales.
+ *
+ * @param mask Masque à remplir (l'ancien contenu est libéré)
+ * @param width Largeur de la transformée
+ * @param height Hauteur de la transformée
+ * @param ref_width Largeur de l'image de référence
+ * @param ref_height Hauteur de l'image de référence
+ * @param param_radius_min Rayon minimal pour le filtre passe-bas
+ * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+static int build_filter_mask(filter_mask *mask, int width, int height,
+                             int ref_width, int ref_height,
+                             float param_radius_min, float param_radius_max_diviser) {
+    release_filter_mask(mask);
+
+    float radius_min = param_radius_min;
+    float radius_max = ref_width / param_radius_max_diviser;
+
+    int half_width = width / 2 + 1;
+
+    // Passage des fréquences de la fenêtre à celles de la référence
+    float scale_x = (float)ref_width / width;
+    float scale_y = (float)ref_height / height;
+
+    float radius_min_squared = radius_min * radius_min;
+    float radius_max_squared = radius_max * radius_max;
+    float radius_diff_inv = 1.0f / (radius_max - radius_min);
+
+    const float PI_2 = PI / 2;
+    const float PI_4 = PI / 4;
+    const float angle_threshold = 0.05f;
+    const float angle_threshold_diag = 0.1f;
+
+    mask->attenuation = fftwf_malloc(sizeof(float) * height * half_width);
+    mask->axis_row_start = malloc(sizeof(int) * (height + 1));
+    if (!mask->attenuation || !mask->axis_row_start) {
+        release_filter_mask(mask);
+        return -1;
+    }
+
+    // Partie géométrique. Les cases axiales reçoivent temporairement l'opposé de leur
+    // atténuation sous le seuil (toujours > 0), pour être reconnues au second passage.
+    #pragma omp parallel for schedule(static)
+    for (int py = 0; py < height; py++) {
+        // Fréquence signée verticale (position dans le spectre centré - centre)
+        int fy = (py + height / 2) % height - height / 2;
+        float *row = &mask->attenuation[py * half_width];
+        int axis_in_row = 0;
+
+        for (int px = 0; px < half_width; px++) {
+            // Fréquence signée horizontale (-width/2 pour la colonne de Nyquist)
+            int fx = (px + width / 2) % width - width / 2;
+
+            float dx = fx * scale_x;
+            float dy = fy * scale_y;
+            float radius_squared = dx * dx + dy * dy;
+
+            float attenuation = 1.0f;
+
+            if (radius_squared > radius_max_squared) {
+                attenuation = 0.0f;
+            } else if (radius_squared <= radius_min_squared) {
+                attenuation = 1.0f;
+            } else {
+                float radius = sqrtf(radius_squared);
+                float angle = atan2f(dy, dx);
+
+                float angle_mod = fmodf(fabsf(angle), PI_2);
+
+                if ((angle_mod < angle_threshold || angle_mod > PI_2 - angle_threshold) &&
+                    radius_squared > 4 * radius_min_squared) {
+                    // Dépend de l'amplitude : 0.01 au-dessus du seuil, rampe sinon
+                    attenuation = -(1.0f - (radius - radius_min) * radius_diff_inv * 0.5f);
+                    axis_in_row++;
+                } else if (fabsf(fmodf(fabsf(angle - PI_4), PI_2)) < angle_threshold_diag &&
+                        radius_squared > 4 * radius_min_squared) {
+                    attenuation = 0.3f;
+                } else {
+                    attenuation = 1.0f - (radius - radius_min) * radius_diff_inv * 0.2f;
+                }
+            }
+
+            row[px] = attenuation;
+        }
+        mask->axis_row_start[py + 1] = axis_in_row;
+    }
+
+    // Cumul des effectifs par ligne
+    mask->axis_row_start[0] = 0;
+    for (int py = 0; py < height; py++) {
+        mask->axis_row_start[py + 1] += mask->axis_row_start[py];
+    }
+    mask->axis_count = mask->axis_row_start[height];
+
+    if (mask->axis_count > 0) {
+        mask->axis_index = malloc(sizeof(int) * mask->axis_count);
+        mask->axis_ramp = malloc(sizeof(float) * mask->axis_count);
+        if (!mask->axis_index || !mask->axis_ramp) {
+            release_filter_mask(mask);
+            return -1;
+        }
+    }
+
+    // Extraction des cases axiales
+    #pragma omp parallel for schedule(static)
+    for (int py = 0; py < height; py++) {
+        float *row = &mask->attenuation[py * half_width];
+        int k = mask->axis_row_start[py];
+        for (int px = 0; px < half_width; px++) {
+            if (row[px] < 0.0f) {
+                mask->axis_index[k] = py * half_width + px;
+                mask->axis_ramp[k] = -row[px];
+                row[px] = 1.0f;
+                k++;
+            }
+        }
+    }
+
+    // L'amplitude d'une composante croît avec le nombre de pixels transformés
+    mask->magnitude_threshold = 10000.0f * ((float)(width * height) / ((float)ref_width * ref_height));
+
+    mask->width = width;
+    mask->height = height;
+    mask->ref_width = ref_width;
+    mask->ref_height = ref_height;
+    mask->radius_min = param_radius_min;
+    mask->radius_max_diviser = param_radius_max_diviser;
+
+    mask->bytes = sizeof(float) * height * half_width + sizeof(int) * (height + 1) +
+                  (sizeof(int) + sizeof(float)) * mask->axis_count;
+    account_alloc(mask->bytes);
+    return 0;
+}
+
+/**
+ * Filtre passe-bas circulaire idéal (cas param_radius_min >= rayon maximal)
+ *
+ * Avec un rayon minimal au moins égal au rayon maximal, chaque fréquence est soit
+ * conservée, soit annulée par le disque de rayon maximal : les règles angulaires et
+ * d'amplitude ne s'appliquent jamais. Dans le format r2c, la fréquence horizontale
+ * d'une colonne vaut |fx| = x, donc chaque ligne garde ses colonnes [0, corde] et la
+ * fin de ligne est mise à zéro d'un bloc.
+ *
+ * @param res Ressources FFTW (taille de la transformée)
+ * @param spectrum Demi-spectre à filtrer
+ * @param ref_width Largeur de l'image de référence
+ * @param ref_height Hauteur de l'image de référence
+ * @param radius_max Rayon maximal en fréquences de la référence
+ */
+static void filter_spectrum_lowpass(const fftw_resources *res, fftwf_complex *spectrum,
+                                    int ref_width, int ref_height, float radius_max) {
+    int width = res->width;
+    int height = res->height;
+    int half_width = width / 2 + 1;
+
+    // Passage des fréquences de la fenêtre à celles de la référence
+    float scale_x = (float)ref_width / width;
+    float scale_y = (float)ref_height / height;
+    float radius_max_squared = radius_max * radius_max;
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        int fy = (y + height / 2) % height - height / 2;
+        float dy = fy * scale_y;
+        float remaining = radius_max_squared - dy * dy;
+
+        // Dernière colonne conservée : estimation puis ajustement sur le critère exact
+        int chord = -1;
+        if (remaining >= 0.0f) {
+            chord = (int)(sqrtf(remaining) / scale_x);
+            if (chord > half_width - 1) {
+                chord = half_width - 1;
+            }
+            while (chord + 1 < half_width &&
+                   ((chord + 1) * scale_x) * ((chord + 1) * scale_x) + dy * dy <= radius_max_squared) {
+                chord++;
+            }
+            while (chord >= 0 && (chord * scale_x) * (chord * scale_x) + dy * dy > radius_max_squared) {
+                chord--;
+            }
+        }
+
+        if (chord + 1 < half_width) {
+            memset(&spectrum[y * half_width + chord + 1], 0,
+                   sizeof(fftwf_complex) * (half_width - chord - 1));
+        }
+    }
+}
+
+/**
+ * Reconstruit le masque d'un jeu de ressources si la géométrie ou les paramètres ont changé
+ * (rien à faire pour le passe-bas pur, qui se passe de masque)
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+static int ensure_filter_mask(fftw_resources *res, int ref_width, int ref_height,
+                              float param_radius_min, float param_radius_max_diviser) {
+    filter_mask *mask = &res->mask;
+
+    if (param_radius_min >= ref_width / param_radius_max_diviser) {
+        return 0;
+    }
+
+    if (!mask->attenuation || mask->width != res->width || mask->height != res->height ||
+        mask->ref_width != ref_width || mask->ref_height != ref_height ||
+        mask->radius_min != param_radius_min || mask->radius_max_diviser != param_radius_max_diviser) {
+        return build_filter_mask(mask, res->width, res->height, ref_width, ref_height,
+                                 param_radius_min, param_radius_max_diviser);
+    }
+    return 0;
+}
+
+/**
+ * Filtre le spectre de fréquence pour éliminer le moiré spécifique aux écrans Kaleido 3
+ *
+ * Le demi-spectre r2c est multiplié sur place par le masque précalculé ; seules les
+ * cases axiales demandent encore un test d'amplitude. Le masque est reconstruit si la
+ * géométrie ou les paramètres ont changé.
+ *
+ * @param res Ressources FFTW (taille de la transformée et masque)
+ * @param spectrum_data Demi-spectre à filtrer (res->fft_result, ou buffer d'une tuile)
+ * @param ref_width Largeur de l'image de référence
+ * @param ref_height Hauteur de l'image de référence
+ * @param param_radius_min Rayon minimal pour le filtre passe-bas
+ * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+int filter_spectrum_for_kaleido(fftw_resources *res, fftwf_complex *spectrum_data,
+                                int ref_width, int ref_height,
+                                float param_radius_min, float param_radius_max_diviser) {
+    filter_mask *mask = &res->mask;
+    int height = res->height;
+    int half_width = res->width / 2 + 1;
+
+    // Configuration de production (param_radius_min = 9999) : passe-bas pur, sans masque
+    float radius_max = ref_width / param_radius_max_diviser;
+    if (param_radius_min >= radius_max) {
+        filter_spectrum_lowpass(res, spectrum_data, ref_width, ref_height, radius_max);
+        return 0;
+    }
+
+    if (ensure_filter_mask(res, ref_width, ref_height, param_radius_min, param_radius_max_diviser) != 0) {
+        return -1;
+    }
+
+    float *spectrum = (float *)spectrum_data;
+    const float *attenuation = mask->attenuation;
+    const float magnitude_threshold_squared = mask->magnitude_threshold * mask->magnitude_threshold;
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        // Cases axiales : atténuation selon l'amplitude d'origine (leur masque vaut 1)
+        for (int k = mask->axis_row_start[y]; k < mask->axis_row_start[y + 1]; k++) {
+            float *bin = &spectrum[2 * mask->axis_index[k]];
+            float magnitude_squared = bin[0] * bin[0] + bin[1] * bin[1];
+            float axis_attenuation = (magnitude_squared > magnitude_threshold_squared) ? 0.01f : mask->axis_ramp[k];
+            bin[0] *= axis_attenuation;
+            bin[1] *= axis_attenuation;
+        }
+
+        // Multiplication par le masque géométrique
+        float *row = &spectrum[2 * y * half_width];
+        const float *mask_row = &attenuation[y * half_width];
+        for (int x = 0; x < half_width; x++) {
+            row[2 * x] *= mask_row[x];
+            row[2 * x + 1] *= mask_row[x];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Source d'un pixel de bourrage situé à la position pos (pos >= size) d'une transformée
+ * de longueur length. La transformée étant périodique, la première moitié du bourrage
+ * prolonge le bord droit (ou bas) de l'image et la seconde le bord gauche (ou haut)
+ * qui lui fait suite. Retourne -1 pour un bourrage à zéro.
+ */
+static inline int padding_source(int pos, int size, int length, int pad_mode) {
+    int after_end = pos - size;          // Distance au dernier pixel de l'image
+    int before_start = length - 1 - pos; // Distance au premier pixel (par périodicité)
+    int src;
+
+    switch (pad_mode) {
+    case MOIRE_PAD_MIRROR:
+        src = (after_end <= before_start) ? size - 1 - after_end : before_start;
+        break;
+    case MOIRE_PAD_REPLICATE:
+        src = (after_end <= before_start) ? size - 1 : 0;
+        break;
+    default:
+        return -1;
+    }
+    return (src < 0) ? 0 : ((src >= size) ? size - 1 : src);
+}
+
+/**
+ * Bande de lignes [*begin, *end[ attribuée au thread courant dans une région parallèle.
+ * Le découpage ne dépend que du nombre de lignes et de threads : chaque thread retrouve
+ * les mêmes lignes d'une étape à l'autre, encore présentes dans ses caches.
+ */
+static inline void thread_row_band(int rows, int *begin, int *end) {
+    int nthreads = omp_get_num_threads();
+    int tid = omp_get_thread_num();
+    *begin = (int)((long long)rows * tid / nthreads);
+    *end = (int)((long long)rows * (tid + 1) / nthreads);
+}
+
+/**
+ * Conversion d'une ligne RGB24 en luminance (r + g + b) / 3, version scalaire
+ * Utilisée lorsque NEON n'est pas disponible et pour les pixels de fin de ligne
+ */
+static inline void luma_row_from_rgb24_scalar(const unsigned char *src, float *dst, int count) {
+    for (int x = 0; x < count; x++) {
+        unsigned char r = src[x * 3 + 0];
+        unsigned char g = src[x * 3 + 1];
+        unsigned char b = src[x * 3 + 2];
+        float gray = (r + g + b)/3;
+        dst[x] = gray;
+    }
+}
+
+/**
+ * Écriture d'une ligne de luminance normalisée en RGB24 (niveaux de gris), version scalaire
+ * Utilisée lorsque NEON n'est pas disponible et pour les pixels de fin de ligne
+ */
+static inline void rgb24_row_from_luma_scalar(const float *src, unsigned char *dst, int count, float norm_factor) {
+    for (int x = 0; x < count; x++) {
+        // Normaliser
+        float pixel_value = src[x] * norm_factor;
+
+        // Limiter les valeurs entre 0 et 255
+        int pixel_int = (int)pixel_value;
+        pixel_int = (pixel_int < 0) ? 0 : ((pixel_int > 255) ? 255 : pixel_int);
+
+        // Écrire la valeur dans les 3 canaux RGB
+        dst[x * 3] = (unsigned char)pixel_int;
+        dst[x * 3 + 1] = (unsigned char)pixel_int;
+        dst[x * 3 + 2] = (unsigned char)pixel_int;
+    }
+}
+
+#ifdef __ARM_NEON
+// Division par 3 en virgule fixe : (s * 21846) >> 16 == s / 3 pour 0 <= s <= 765
+#define LUMA_DIV3_MUL 21846
+
+/**
+ * Conversion RGB24 → luminance avec NEON, 8 pixels à la fois
+ * Donne exactement le même résultat que la version scalaire
+ */
+static inline void luma_row_from_rgb24_neon(const unsigned char *src, float *dst, int count) {
+    int x = 0;
+
+    for (; x + 8 <= count; x += 8) {
+        // Chargement des 8 pixels (24 octets) avec désentrelacement des canaux RGB
+        uint8x8x3_t pixels = vld3_u8(src + x * 3);
+
+        // Somme des canaux sur 16 bits
+        uint16x8_t sum = vaddw_u8(vaddl_u8(pixels.val[0], pixels.val[1]), pixels.val[2]);
+
+        // Division par 3 en virgule fixe sur 32 bits, puis conversion en flottants
+        uint32x4_t gray_lo = vshrq_n_u32(vmull_n_u16(vget_low_u16(sum), LUMA_DIV3_MUL), 16);
+        uint32x4_t gray_hi = vshrq_n_u32(vmull_n_u16(vget_high_u16(sum), LUMA_DIV3_MUL), 16);
+        vst1q_f32(dst + x, vcvtq_f32_u32(gray_lo));
+        vst1q_f32(dst + x + 4, vcvtq_f32_u32(gray_hi));
+    }
+
+    // Pixels restants
+    luma_row_from_rgb24_scalar(src + x * 3, dst + x, count - x);
+}
+
+/**
+ * Écriture luminance → RGB24 avec NEON, 8 pixels à la fois
+ * Conversion avec troncature et réductions saturées (équivalent au clamp [0, 255] scalaire)
+ */
+static inline void rgb24_row_from_luma_neon(const float *src, unsigned char *dst, int count, float norm_factor) {
+    int x = 0;
+
+    for (; x + 8 <= count; x += 8) {
+        // Normaliser puis tronquer vers zéro comme le cast (int) scalaire
+        int32x4_t v_lo = vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(src + x), norm_factor));
+        int32x4_t v_hi = vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(src + x + 4), norm_factor));
+
+        // Réductions saturées : négatifs → 0, au-delà de 255 → 255
+        uint16x8_t v16 = vcombine_u16(vqmovun_s32(v_lo), vqmovun_s32(v_hi));
+        uint8x8_t v8 = vqmovn_u16(v16);
+
+        // Écrire la valeur dans les 3 canaux RGB
+        uint8x8x3_t pixels;
+        pixels.val[0] = v8;
+        pixels.val[1] = v8;
+        pixels.val[2] = v8;
+        vst3_u8(dst + x * 3, pixels);
+    }
+
+    // Pixels restants
+    rgb24_row_from_luma_scalar(src + x, dst + x * 3, count - x, norm_factor);
+}
+#endif
+
+/**
+ * Conversion d'une ligne RGB24 en luminance avec détection de couleur, version scalaire
+ * Un pixel est coloré si l'écart entre deux de ses canaux dépasse la tolérance
+ * (même critère que is_framebuffer_colored de color_detect)
+ * @return 1 si la ligne contient un pixel coloré, 0 sinon
+ */
+static inline int luma_row_from_rgb24_detect_scalar(const unsigned char *src, float *dst, int count,
+                                                    int tolerance) {
+    int colored = 0;
+    for (int x = 0; x < count; x++) {
+        int r = src[x * 3 + 0];
+        int g = src[x * 3 + 1];
+        int b = src[x * 3 + 2];
+        colored |= (abs(r - g) > tolerance) | (abs(r - b) > tolerance) | (abs(g - b) > tolerance);
+        float gray = (r + g + b)/3;
+        dst[x] = gray;
+    }
+    return colored;
+}
+
+#ifdef __ARM_NEON
+/**
+ * Conversion RGB24 → luminance avec détection de couleur, avec NEON
+ * Les masques de couleur sont accumulés sur toute la ligne et testés une seule fois
+ * @return 1 si la ligne contient un pixel coloré, 0 sinon
+ */
+static inline int luma_row_from_rgb24_detect_neon(const unsigned char *src, float *dst, int count,
+                                                  int tolerance) {
+    uint8x8_t tolerance_vec = vdup_n_u8((uint8_t)tolerance);
+    uint8x8_t colored = vdup_n_u8(0);
+    int x = 0;
+
+    for (; x + 8 <= count; x += 8) {
+        uint8x8x3_t pixels = vld3_u8(src + x * 3);
+
+        // Détection : écarts absolus entre canaux comparés à la tolérance
+        uint8x8_t diff_rg = vabd_u8(pixels.val[0], pixels.val[1]);
+        uint8x8_t diff_rb = vabd_u8(pixels.val[0], pixels.val[2]);
+        uint8x8_t diff_gb = vabd_u8(pixels.val[1], pixels.val[2]);
+        colored = vorr_u8(colored, vcgt_u8(diff_rg, tolerance_vec));
+        colored = vorr_u8(colored, vcgt_u8(diff_rb, tolerance_vec));
+        colored = vorr_u8(colored, vcgt_u8(diff_gb, tolerance_vec));
+
+        // Luminance (voir luma_row_from_rgb24_neon)
+        uint16x8_t sum = vaddw_u8(vaddl_u8(pixels.val[0], pixels.val[1]), pixels.val[2]);
+        uint32x4_t gray_lo = vshrq_n_u32(vmull_n_u16(vget_low_u16(sum), LUMA_DIV3_MUL), 16);
+        uint32x4_t gray_hi = vshrq_n_u32(vmull_n_u16(vget_high_u16(sum), LUMA_DIV3_MUL), 16);
+        vst1q_f32(dst + x, vcvtq_f32_u32(gray_lo));
+        vst1q_f32(dst + x + 4, vcvtq_f32_u32(gray_hi));
+    }
+
+    // Pixels restants
+    int tail_colored = luma_row_from_rgb24_detect_scalar(src + x * 3, dst + x, count - x, tolerance);
+    return tail_colored || vget_lane_u64(vreinterpret_u64_u8(colored), 0) != 0;
+}
+#endif
+
+/**
+ * Conversion d'une ligne RGB24 en luminance (sélection de l'implémentation optimale)
+ */
+static inline void luma_row_from_rgb24(const unsigned char *src, float *dst, int count) {
+#ifdef __ARM_NEON
+    luma_row_from_rgb24_neon(src, dst, count);
+#else
+    luma_row_from_rgb24_scalar(src, dst, count);
+#endif
+}
+
+/**
+ * Écriture d'une ligne de luminance en RGB24 (sélection de l'implémentation optimale)
+ */
+static inline void rgb24_row_from_luma(const float *src, unsigned char *dst, int count, float norm_factor) {
+#ifdef __ARM_NEON
+    rgb24_row_from_luma_neon(src, dst, count, norm_factor);
+#else
+    rgb24_row_from_luma_scalar(src, dst, count, norm_factor);
+#endif
+}
+
+/**
+ * Conversion d'une ligne RGB24 en luminance avec détection de couleur
+ * (sélection de l'implémentation optimale)
+ */
+static inline int luma_row_from_rgb24_detect(const unsigned char *src, float *dst, int count, int tolerance) {
+#ifdef __ARM_NEON
+    return luma_row_from_rgb24_detect_neon(src, dst, count, tolerance);
+#else
+    return luma_row_from_rgb24_detect_scalar(src, dst, count, tolerance);
+#endif
+}
+
+/**
+ * Conversion d'une ligne de luminance 8 bits en flottants
+ */
+static inline void luma_row_from_gray8(const unsigned char *src, float *dst, int count) {
+    int x = 0;
+#ifdef __ARM_NEON
+    for (; x + 8 <= count; x += 8) {
+        uint16x8_t gray = vmovl_u8(vld1_u8(src + x));
+        vst1q_f32(dst + x, vcvtq_f32_u32(vmovl_u16(vget_low_u16(gray))));
+        vst1q_f32(dst + x + 4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(gray))));
+    }
+#endif
+    for (; x < count; x++) {
+        dst[x] = src[x];
+    }
+}
+
+/**
+ * Copie 8 bits d'une ligne de luminance (valeurs entières de 0 à 255)
+ */
+static inline void gray8_row_from_luma(const float *src, unsigned char *dst, int count) {
+    for (int x = 0; x < count; x++) {
+        dst[x] = (unsigned char)src[x];
+    }
+}
+
+/**
+ * Copie 8 bits d'une ligne RGB24 en niveaux de gris (canal rouge)
+ */
+static inline void gray8_row_from_rgb24(const unsigned char *src, unsigned char *dst, int count) {
+    for (int x = 0; x < count; x++) {
+        dst[x] = src[x * 3];
+    }
+}
+
+/**
+ * Ligne RGB24 depuis une ligne 8 bits en niveaux de gris (version scalaire)
+ */
+static inline void rgb24_row_from_gray8_scalar(const unsigned char *src, unsigned char *dst, int count) {
+    for (int x = 0; x < count; x++) {
+        dst[x * 3] = dst[x * 3 + 1] = dst[x * 3 + 2] = src[x];
+    }
+}
+
+#ifdef __ARM_NEON
+/**
+ * Ligne RGB24 depuis une ligne 8 bits en niveaux de gris, 16 pixels par itération
+ */
+static inline void rgb24_row_from_gray8_neon(const unsigned char *src, unsigned char *dst, int count) {
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        uint8x16x3_t rgb;
+        rgb.val[0] = rgb.val[1] = rgb.val[2] = vld1q_u8(src + x);
+        vst3q_u8(dst + x * 3, rgb);
+    }
+    rgb24_row_from_gray8_scalar(src + x, dst + x * 3, count - x);
+}
+#endif
+
+static inline void rgb24_row_from_gray8(const unsigned char *src, unsigned char *dst, int count) {
+#ifdef __ARM_NEON
+    rgb24_row_from_gray8_neon(src, dst, count);
+#else
+    rgb24_row_from_gray8_scalar(src, dst, count);
+#endif
+}
+
+/**
+ * Interpolation entre deux lignes : dst = a + (b - a) * weight (version scalaire)
+ */
+static inline void blend_rows_scalar(const float *a, const float *b, float *dst, int count, float weight) {
+    for (int x = 0; x < count; x++) {
+        dst[x] = a[x] + (b[x] - a[x]) * weight;
+    }
+}
+
+/**
+ * Agrandissement d'une ligne d'un facteur entier (2 à MOIRE_DECIMATION_MAX) par
+ * interpolation linéaire entre les centres des pixels, version scalaire
+ * La sortie dst[i * factor + p] (phase p) est interpolée entre src[i + o] et
+ * src[i + o + 1], avec o = -1 pour les phases situées avant le centre du pixel source
+ * (src doit être lisible de src - 1 à src + count)
+ */
+static inline void upsample_row_scalar(const float *src, float *dst, int count, int factor) {
+    for (int p = 0; p < factor; p++) {
+        float pos = (p + 0.5f) / factor - 0.5f;
+        int offset = (pos < 0.0f) ? -1 : 0;
+        float weight = pos - offset;
+        for (int i = 0; i < count; i++) {
+            float a = src[i + offset];
+            dst[i * factor + p] = a + (src[i + offset + 1] - a) * weight;
+        }
+    }
+}
+
+#ifdef __ARM_NEON
+/**
+ * Version NEON de blend_rows_scalar, 4 pixels par itération
+ */
+static inline void blend_rows_neon(const float *a, const float *b, float *dst, int count, float weight) {
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        float32x4_t va = vld1q_f32(a + x);
+        vst1q_f32(dst + x, vmlaq_n_f32(va, vsubq_f32(vld1q_f32(b + x), va), weight));
+    }
+    blend_rows_scalar(a + x, b + x, dst + x, count - x, weight);
+}
+
+/**
+ * Version NEON de upsample_row_scalar : 4 pixels source par itération, les phases
+ * étant entrelacées à l'écriture par vst2q/vst3q/vst4q selon le facteur
+ */
+static inline void upsample_row_neon(const float *src, float *dst, int count, int factor) {
+    float weights[MOIRE_DECIMATION_MAX];
+    int before[MOIRE_DECIMATION_MAX];
+    for (int p = 0; p < factor; p++) {
+        float pos = (p + 0.5f) / factor - 0.5f;
+        before[p] = pos < 0.0f;
+        weights[p] = before[p] ? pos + 1.0f : pos;
+    }
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t prev = vld1q_f32(src + i - 1);
+        float32x4_t cur = vld1q_f32(src + i);
+        float32x4_t next = vld1q_f32(src + i + 1);
+        float32x4_t phases[MOIRE_DECIMATION_MAX];
+        for (int p = 0; p < factor; p++) {
+            phases[p] = before[p] ? vmlaq_n_f32(prev, vsubq_f32(cur, prev), weights[p])
+                                  : vmlaq_n_f32(cur, vsubq_f32(next, cur), weights[p]);
+        }
+        float *out = dst + i * factor;
+        if (factor == 2) {
+            float32x4x2_t v = { { phases[0], phases[1] } };
+            vst2q_f32(out, v);
+        } else if (factor == 3) {
+            float32x4x3_t v = { { phases[0], phases[1], phases[2] } };
+            vst3q_f32(out, v);
+        } else {
+            float32x4x4_t v = { { phases[0], phases[1], phases[2], phases[3] } };
+            vst4q_f32(out, v);
+        }
+    }
+    upsample_row_scalar(src + i, dst + i * factor, count - i, factor);
+}
+#endif
+
+static inline void blend_rows(const float *a, const float *b, float *dst, int count, float weight) {
+#ifdef __ARM_NEON
+    blend_rows_neon(a, b, dst, count, weight);
+#else
+    blend_rows_scalar(a, b, dst, count, weight);
+#endif
+}
+
+static inline void upsample_row(const float *src, float *dst, int count, int factor) {
+#ifdef __ARM_NEON
+    upsample_row_neon(src, dst, count, factor);
+#else
+    upsample_row_scalar(src, dst, count, factor);
+#endif
+}
+
+/**
+ * Remplit les colonnes de bourrage d'une ligne du plan de luminance
+ */
+static inline void pad_luma_row(const fftw_resources *res, float *row) {
+    for (int x = res->image_width; x < res->width; x++) {
+        int src = padding_source(x, res->image_width, res->width, res->pad_mode);
+        row[x] = (src < 0) ? 0.0f : row[src];
+    }
+}
+
+/**
+ * Remplit une ligne de bourrage complète (sous l'image) du plan de luminance
+ */
+static inline void pad_luma_bottom_row(const fftw_resources *res, int y) {
+    float *plane = res->fft_input_tmp;
+    int stride = res->real_stride;
+    int src = padding_source(y, res->image_height, res->height, res->pad_mode);
+
+    if (src < 0) {
+        memset(&plane[y * stride], 0, sizeof(float) * res->width);
+    } else {
+        memcpy(&plane[y * stride], &plane[src * stride], sizeof(float) * res->width);
+    }
+}
+
+/**
+ * Applique la FFT 2D à une image en niveaux de gris
+ * Implémente l'algorithme de Cooley-Tukey (par lignes puis colonnes)
+ * Le demi-spectre r2c est laissé dans res->fft_result
+ *
+ * La conversion en luminance et le bourrage se font dans une seule région parallèle :
+ * chaque thread traite sa bande de lignes, puis, après une barrière, sa part des
+ * lignes de bourrage (qui recopient des lignes d'autres bandes).
+ *
+ * Avec une tolérance positive ou nulle, la détection de couleur est faite pendant la
+ * même lecture des pixels : dès qu'un pixel coloré est trouvé, tous les threads
+ * abandonnent la conversion et la FFT n'est pas exécutée.
+ *
+ * @param res Ressources FFTW (fixent la largeur et la hauteur traitées)
+ * @param input_data Données de l'image d'entrée
+ * @param line_length Longueur de ligne (peut inclure padding)
+ * @param tolerance Tolérance de détection de couleur (négative : pas de détection)
+ * @param io Luminance 8 bits à lire à la place de l'image et copie de celle-ci (NULL : aucune)
+ * @return 1 si l'image contient de la couleur (rien n'est transformé), 0 sinon
+ */
+int fft2d_grayscale(fftw_resources *res, unsigned char *input_data, int line_length, int tolerance,
+                    const luma_io *io) {
+    int pad_columns = res->width > res->image_width;
+    int pad_rows = res->height - res->image_height;
+    int detect = tolerance >= 0;
+    int found_colored = 0;
+    double start = omp_get_wtime();
+
+    #pragma omp parallel
+    {
+        int y0, y1;
+
+        // Conversion RGB24 → niveau de gris (luminance) et bourrage à droite
+        thread_row_band(res->image_height, &y0, &y1);
+        for (int y = y0; y < y1; y++) {
+            float *row = &res->fft_input_tmp[y * res->real_stride];
+            if (io && io->gray) {
+                luma_row_from_gray8(&io->gray[y * io->stride], row, res->image_width);
+            } else if (detect) {
+                // Vérification rapide si un autre thread a déjà trouvé un pixel coloré
+                int stop;
+                #pragma omp atomic read
+                stop = found_colored;
+                if (stop) {
+                    break;
+                }
+                if (luma_row_from_rgb24_detect(&input_data[y * line_length], row,
+                                               res->image_width, tolerance)) {
+                    #pragma omp atomic write
+                    found_colored = 1;
+                    break;
+                }
+            } else {
+                luma_row_from_rgb24(&input_data[y * line_length], row, res->image_width);
+            }
+            if (io && io->gray_copy) {
+                gray8_row_from_luma(row, &io->gray_copy[y * io->stride], res->image_width);
+            }
+            if (pad_columns) {
+                pad_luma_row(res, row);
+            }
+        }
+
+        // Bourrage sous l'image (la barrière rend found_colored identique pour tous les threads)
+        if (pad_rows > 0) {
+            #pragma omp barrier
+            if (!found_colored) {
+                thread_row_band(pad_rows, &y0, &y1);
+                for (int y = y0; y < y1; y++) {
+                    pad_luma_bottom_row(res, res->image_height + y);
+                }
+            }
+        }
+    }
+    res->stage_ms[MOIRE_STAGE_LOAD] = (omp_get_wtime() - start) * 1000.0;
+
+    if (found_colored) {
+        return 1;
+    }
+
+    // Appliquer la FFT 2D avec le plan préexistant
+    // (exécution sur les buffers courants, qui ont pu être réalloués depuis la planification)
+    start = omp_get_wtime();
+    fftwf_execute_dft_r2c(res->fft2d_plan, res->fft_input_tmp, res->fft_result);
+    res->stage_ms[MOIRE_STAGE_FFT] = (omp_get_wtime() - start) * 1000.0;
+    // Note: on ne détruit pas le plan ni ne libère la mémoire ici
+    return 0;
+}
+
+
+/**
+ * Applique la transformée de Fourier inverse 2D pour récupérer l'image
+ * à partir du demi-spectre filtré de res->fft_result
+ * Seule la zone [out_x, out_x + out_w[ x [out_y, out_y + out_h[ est réécrite,
+ * hors des tuiles marquées dans le masque éventuel
+ *
+ * @param res Ressources FFTW (fixent la largeur et la hauteur traitées)
+ * @param output_data Données de sortie de l'image
+ * @param line_length Longueur de ligne (peut inclure padding)
+ * @param out_x Abscisse de la zone à réécrire
+ * @param out_y Ordonnée de la zone à réécrire
+ * @param out_w Largeur de la zone à réécrire
+ * @param out_h Hauteur de la zone à réécrire
+ * @param mask Tuiles à laisser intactes (coordonnées de la fenêtre), NULL pour tout réécrire
+ * @param io Copie 8 bits de la zone réécrite (io->out_copy, sans masque), NULL : aucune
+ */
+void ifft2d_grayscale(fftw_resources *res, unsigned char *output_data,
+                     int line_length, int out_x, int out_y, int out_w, int out_h,
+                     const output_mask *mask, const luma_io *io) {
+    // Appliquer la IFFT 2D avec le plan préexistant
+    double start = omp_get_wtime();
+    fftwf_execute_dft_c2r(res->ifft2d_plan, res->fft_result, res->ifft_result);
+    res->stage_ms[MOIRE_STAGE_IFFT] = (omp_get_wtime() - start) * 1000.0;
+
+    // Normaliser et convertir les résultats en RGB (image en niveaux de gris),
+    // avec le même découpage en bandes que la conversion en luminance
+    float norm_factor = 1.0f / (res->width * res->height);
+    start = omp_get_wtime();
+
+    #pragma omp parallel
+    {
+        int y0, y1;
+        thread_row_band(out_h, &y0, &y1);
+        for (int y = out_y + y0; y < out_y + y1; y++) {
+            const float *src = &res->ifft_result[y * res->real_stride];
+            unsigned char *dst = &output_data[y * line_length];
+
+            if (!mask) {
+                rgb24_row_from_luma(src + out_x, dst + out_x * 3, out_w, norm_factor);
+                if (io && io->out_copy) {
+                    gray8_row_from_rgb24(dst + out_x * 3, &io->out_copy[y * io->stride + out_x], out_w);
+                }
+                continue;
+            }
+
+            // Réécrire chaque suite de tuiles non masquées en un seul appel
+            const unsigned char *tile_row = mask->tiles + (y / mask->tile_size) * mask->tiles_x;
+            int x = out_x;
+            while (x < out_x + out_w) {
+                int tile_end = (x / mask->tile_size + 1) * mask->tile_size;
+                int run_end = (tile_end < out_x + out_w) ? tile_end : out_x + out_w;
+                int keep = tile_row[x / mask->tile_size];
+
+                // Étendre la suite tant que les tuiles suivantes ont le même état
+                while (run_end < out_x + out_w && tile_row[run_end / mask->tile_size] == keep) {
+                    run_end += mask->tile_size;
+                    run_end = (run_end < out_x + out_w) ? run_end : out_x + out_w;
+                }
+
+                if (!keep) {
+                    rgb24_row_from_luma(src + x, dst + x * 3, run_end - x, norm_factor);
+                }
+                x = run_end;
+            }
+        }
+    }
+    res->stage_ms[MOIRE_STAGE_STORE] = (omp_get_wtime() - start) * 1000.0;
+    // Note: on ne détruit pas le plan ni ne libère la mémoire ici
+}
+
+/**
+ * Enchaîne FFT, filtrage et IFFT sur une fenêtre de la taille des ressources fournies
+ * (3 régions parallèles : conversion et bourrage, filtrage, écriture ; plus les
+ * exécutions multi-threads de FFTW)
+ *
+ * @param res Ressources FFTW de la fenêtre
+ * @param window_data Premier pixel de la fenêtre dans le framebuffer
+ * @param line_length Longueur de ligne du framebuffer
+ * @param ref_width Largeur de l'écran (référence des rayons du filtre)
+ * @param ref_height Hauteur de l'écran
+ * @param out_x, out_y, out_w, out_h Zone de la fenêtre réécrite dans le framebuffer
+ * @param tolerance Tolérance de détection de couleur (négative : pas de détection)
+ * @param mask Tuiles à laisser intactes, NULL pour réécrire toute la zone
+ * @param io Lecture et copies de la luminance 8 bits (mode incrémental), NULL : aucune
+ * @return 0 en cas de succès, 1 si la fenêtre contient de la couleur (laissée intacte),
+ *         -1 en cas d'erreur
+ */
+static int filter_window(fftw_resources *res, unsigned char *window_data, int line_length,
+                         int ref_width, int ref_height,
+                         int out_x, int out_y, int out_w, int out_h,
+                         float param_radius_min, float param_radius_max_diviser, int tolerance,
+                         const output_mask *mask, const luma_io *io) {
+    double frame_start = omp_get_wtime();
+
+    // Réattacher les buffers libérés par trim_moire_resources() (les plans sont conservés)
+    if (!res->fft_input_tmp && allocate_fftw_buffers(res) != 0) {
+        return -1;
+    }
+
+    // Appliquer la FFT 2D (abandonnée si de la couleur est détectée)
+    if (fft2d_grayscale(res, window_data, line_length, tolerance, io) != 0) {
+        return 1;
+    }
+
+    // Filtrer le demi-spectre sur place pour éliminer le moiré
+    double start = omp_get_wtime();
+    if (filter_spectrum_for_kaleido(res, res->fft_result, ref_width, ref_height,
+                                    param_radius_min, param_radius_max_diviser) != 0) {
+        return -1;
+    }
+    res->stage_ms[MOIRE_STAGE_FILTER] = (omp_get_wtime() - start) * 1000.0;
+
+    // Appliquer l'IFFT 2D
+    ifft2d_grayscale(res, window_data, line_length, out_x, out_y, out_w, out_h, mask, io);
+
+    res->stage_ms[MOIRE_STAGE_TOTAL] = (omp_get_wtime() - frame_start) * 1000.0;
+    return 0;
+}
+
+/**
+ * Indice d'une ligne ou colonne hors de l'image, ramené dans l'image par symétrie
+ * (bords en miroir autour des tuiles qui débordent)
+ */
+static inline int mirror_index(int pos, int size) {
+    if (pos < 0) {
+        pos = -pos - 1;
+    }
+    if (pos >= size) {
+        pos = 2 * size - 1 - pos;
+    }
+    return (pos < 0) ? 0 : ((pos >= size) ? size - 1 : pos);
+}
+
+/**
+ * Prépare le moteur par tuiles pour la taille d'écran et la taille de tuile courantes
+ * Les plans sont créés mono-thread : chaque thread les exécute sur son propre buffer.
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+static int prepare_tiled_engine(int width, int height) {
+    const int n = g_tile_fft_size;
+    const int hop = n / 2;
+    const int threads = omp_get_max_threads();
+
+    if (g_tiled.plans.fft2d_plan && (g_tiled.plans.width != n || g_tiled.image_width != width ||
+                                     g_tiled.image_height != height ||
+                                     (g_tiled.thread_count && g_tiled.thread_count != threads))) {
+        release_tiled_engine();
+    }
+
+    // Plans (sur place, comme en mode économe) et buffer du premier thread
+    if (!g_tiled.plans.fft2d_plan) {
+        if (create_fftw_resources(&g_tiled.plans, n, n, MOIRE_PAD_NONE, 1, 1, FFTW_MEASURE) != 0) {
+            return -1;
+        }
+    } else if (!g_tiled.plans.fft_input_tmp && allocate_fftw_buffers(&g_tiled.plans) != 0) {
+        return -1;
+    }
+
+    if (g_tiled.strip) {
+        return 0;
+    }
+
+    // Buffers des autres threads, fenêtre et lignes de la rangée en cours
+    const int stride = (width + hop - 1) / hop * hop + 2 * hop;
+    const size_t tile_bytes = g_tiled.plans.bytes;
+    g_tiled.image_width = width;
+    g_tiled.image_height = height;
+    g_tiled.strip_stride = stride;
+    g_tiled.tile_buffers = calloc(threads, sizeof(float *));
+    g_tiled.window = malloc(sizeof(float) * n);
+    g_tiled.strip = malloc(sizeof(float) * n * stride);
+    g_tiled.accum = malloc(sizeof(float) * n * stride);
+    g_tiled.reserve = malloc((size_t)n * width);
+    if (!g_tiled.tile_buffers || !g_tiled.window || !g_tiled.strip || !g_tiled.accum || !g_tiled.reserve) {
+        release_tiled_buffers();
+        return -1;
+    }
+
+    g_tiled.tile_buffers[0] = g_tiled.plans.fft_input_tmp;
+    g_tiled.thread_count = 1;
+    for (int i = 1; i < threads; i++) {
+        g_tiled.tile_buffers[i] = fftwf_malloc(tile_bytes);
+        if (!g_tiled.tile_buffers[i]) {
+            release_tiled_buffers();
+            return -1;
+        }
+        g_tiled.thread_count++;
+    }
+
+    // Racine de la fenêtre de Hann périodique : sin² + cos² = 1 entre deux tuiles voisines
+    for (int i = 0; i < n; i++) {
+        g_tiled.window[i] = sinf(PI * i / n);
+    }
+
+    g_tiled.bytes = tile_bytes * (threads - 1) + sizeof(float *) * threads + sizeof(float) * n +
+                    sizeof(float) * 2 * n * stride + (size_t)n * width;
+    account_alloc(g_tiled.bytes);
+    return 0;
+}
+
+/**
+ * Filtre une tuile de la rangée en cours et ajoute sa synthèse aux lignes d'accumulation
+ * @param buffer Buffer de tuile du thread
+ * @param start Colonne de la tuile dans les lignes de la rangée (marge gauche comprise)
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+static int filter_tile(float *buffer, int start, int ref_width, int ref_height,
+                       float param_radius_min, float param_radius_max_diviser) {
+    fftw_resources *res = &g_tiled.plans;
+    const int n = res->width;
+    const int stride = g_tiled.strip_stride;
+    const float *window = g_tiled.window;
+
+    // Fenêtre d'analyse
+    for (int y = 0; y < n; y++) {
+        const float *src = &g_tiled.strip[y * stride + start];
+        float *dst = &buffer[y * res->real_stride];
+        for (int x = 0; x < n; x++) {
+            dst[x] = src[x] * window[x] * window[y];
+        }
+    }
+
+    fftwf_execute_dft_r2c(res->fft2d_plan, buffer, (fftwf_complex *)buffer);
+    if (filter_spectrum_for_kaleido(res, (fftwf_complex *)buffer, ref_width, ref_height,
+                                    param_radius_min, param_radius_max_diviser) != 0) {
+        return -1;
+    }
+    fftwf_execute_dft_c2r(res->ifft2d_plan, (fftwf_complex *)buffer, buffer);
+
+    // Fenêtre de synthèse et addition (les tuiles d'une même phase ne se recouvrent pas)
+    for (int y = 0; y < n; y++) {
+        const float *src = &buffer[y * res->real_stride];
+        float *dst = &g_tiled.accum[y * stride + start];
+        for (int x = 0; x < n; x++) {
+            dst[x] += src[x] * window[x] * window[y];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Filtre l'écran complet avec le moteur par tuiles (overlap-add)
+ *
+ * Pour chaque rangée de tuiles : conversion des N lignes couvertes en luminance (bords
+ * en miroir), filtrage des tuiles paires puis impaires (deux tuiles d'une même phase
+ * ne se recouvrent pas), puis écriture des N/2 lignes qui ne recevront plus de
+ * contribution. Les N dernières lignes de l'image sont mises de côté au départ, car le
+ * miroir du bas les relit après l'écriture des lignes situées au-dessus.
+ *
+ * Les rayons du filtre sont exprimés en fréquences de l'écran, comme pour les fenêtres
+ * des rectangles : le masque est ramené à l'échelle des tuiles.
+ * Étapes chronométrées : luminance (MOIRE_STAGE_LOAD), tuiles complètes FFT, filtrage
+ * et FFT inverse (MOIRE_STAGE_FFT), écriture (MOIRE_STAGE_STORE).
+ *
+ * @param tolerance Tolérance de détection de couleur, vérifiée sur toute l'image avant
+ *        la première écriture (négative : pas de détection)
+ * @param io Lecture et copies de la luminance 8 bits (mode incrémental), NULL : aucune
+ * @return 0 en cas de succès, 1 si l'image contient de la couleur (laissée intacte),
+ *         -1 en cas d'erreur
+ */
+static int filter_frame_tiled(unsigned char *fb_data, int width, int height, int line_length,
+                              float param_radius_min, float param_radius_max_diviser, int tolerance,
+                              const luma_io *io) {
+    double frame_start = omp_get_wtime();
+
+    if (prepare_tiled_engine(width, height) != 0 ||
+        ensure_filter_mask(&g_tiled.plans, width, height, param_radius_min, param_radius_max_diviser) != 0) {
+        return -1;
+    }
+
+    const int n = g_tiled.plans.width;
+    const int hop = n / 2;
+    const int stride = g_tiled.strip_stride;
+    const int tiles_x = (width - 1) / hop + 2;
+    const int tiles_y = (height - 1) / hop + 2;
+    const int reserve_start = (height > n) ? height - n : 0;
+    const int read_gray = io && io->gray;
+    int found_colored = 0;
+    int failed = 0;
+    double load_ms = 0.0, tile_ms = 0.0, store_ms = 0.0;
+
+    // Mise de côté des dernières lignes et détection de couleur sur toute l'image
+    double start = omp_get_wtime();
+    if (!read_gray) {
+        const int first = (tolerance >= 0) ? 0 : reserve_start;
+        #pragma omp parallel
+        {
+            float *row = &g_tiled.strip[(omp_get_thread_num() % n) * stride];
+            int y0, y1;
+            thread_row_band(height - first, &y0, &y1);
+            for (int y = first + y0; y < first + y1; y++) {
+                const unsigned char *src = &fb_data[y * line_length];
+                if (tolerance >= 0) {
+                    int stop;
+                    #pragma omp atomic read
+                    stop = found_colored;
+                    if (stop) {
+                        break;
+                    }
+                    if (luma_row_from_rgb24_detect(src, row, width, tolerance)) {
+                        #pragma omp atomic write
+                        found_colored = 1;
+                        break;
+                    }
+                } else {
+                    luma_row_from_rgb24(src, row, width);
+                }
+                if (y >= reserve_start) {
+                    gray8_row_from_luma(row, &g_tiled.reserve[(y - reserve_start) * width], width);
+                }
+            }
+        }
+    }
+    load_ms += (omp_get_wtime() - start) * 1000.0;
+
+    if (found_colored) {
+        return 1;
+    }
+
+    memset(g_tiled.accum, 0, sizeof(float) * n * stride);
+    const float norm_factor = 1.0f / (n * n);
+
+    for (int ty = 0; ty < tiles_y && !failed; ty++) {
+        const int origin = ty * hop - hop;
+
+        // Lignes de la rangée, marges gauche et droite en miroir
+        start = omp_get_wtime();
+        #pragma omp parallel for schedule(static)
+        for (int r = 0; r < n; r++) {
+            int y = mirror_index(origin + r, height);
+            float *row = &g_tiled.strip[r * stride];
+            if (read_gray) {
+                luma_row_from_gray8(&io->gray[y * io->stride], row + hop, width);
+            } else if (y >= reserve_start) {
+                luma_row_from_gray8(&g_tiled.reserve[(y - reserve_start) * width], row + hop, width);
+            } else {
+                luma_row_from_rgb24(&fb_data[y * line_length], row + hop, width);
+            }
+            if (io && io->gray_copy && y == origin + r) {
+                gray8_row_from_luma(row + hop, &io->gray_copy[y * io->stride], width);
+            }
+            for (int x = 0; x < hop; x++) {
+                row[x] = row[hop + mirror_index(x - hop, width)];
+            }
+            for (int x = hop + width; x < stride; x++) {
+                row[x] = row[hop + mirror_index(x - hop, width)];
+            }
+        }
+        load_ms += (omp_get_wtime() - start) * 1000.0;
+
+        // Tuiles paires puis impaires, chacune dans le buffer de son thread
+        start = omp_get_wtime();
+        #pragma omp parallel num_threads(g_tiled.thread_count)
+        {
+            float *buffer = g_tiled.tile_buffers[omp_get_thread_num()];
+            for (int phase = 0; phase < 2; phase++) {
+                #pragma omp for schedule(dynamic)
+                for (int tx = phase; tx < tiles_x; tx += 2) {
+                    if (filter_tile(buffer, tx * hop, width, height,
+                                    param_radius_min, param_radius_max_diviser) != 0) {
+                        #pragma omp atomic write
+                        failed = 1;
+                    }
+                }
+            }
+        }
+        tile_ms += (omp_get_wtime() - start) * 1000.0;
+
+        // Écriture des lignes complètes, puis décalage des lignes d'accumulation
+        start = omp_get_wtime();
+        int y_begin = (origin < 0) ? 0 : origin;
+        int y_end = (origin + hop < height) ? origin + hop : height;
+        #pragma omp parallel for schedule(static)
+        for (int y = y_begin; y < y_end; y++) {
+            unsigned char *dst = &fb_data[y * line_length];
+            rgb24_row_from_luma(&g_tiled.accum[(y - origin) * stride + hop], dst, width, norm_factor);
+            if (io && io->out_copy) {
+                gray8_row_from_rgb24(dst, &io->out_copy[y * io->stride], width);
+            }
+        }
+        memmove(g_tiled.accum, g_tiled.accum + hop * stride, sizeof(float) * (n - hop) * stride);
+        memset(g_tiled.accum + (n - hop) * stride, 0, sizeof(float) * hop * stride);
+        store_ms += (omp_get_wtime() - start) * 1000.0;
+    }
+
+    g_stage_ms[MOIRE_STAGE_LOAD] = load_ms;
+    g_stage_ms[MOIRE_STAGE_FFT] = tile_ms;
+    g_stage_ms[MOIRE_STAGE_FILTER] = 0.0;
+    g_stage_ms[MOIRE_STAGE_IFFT] = 0.0;
+    g_stage_ms[MOIRE_STAGE_STORE] = store_ms;
+    g_stage_ms[MOIRE_STAGE_TOTAL] = (omp_get_wtime() - frame_start) * 1000.0;
+    return failed ? -1 : 0;
+}
+
+/**
+ * Noyau passe-bas symétrique du moteur spatial : sinus cardinal fenêtré par une fenêtre
+ * de Hann, de gain unité en continu
+ * @param taps Sortie : coefficients 0 à SPATIAL_KERNEL_RADIUS (le noyau est symétrique)
+ * @param cutoff Fréquence de coupure en cycles par pixel (0.5 : aucune coupure)
+ */
+static void build_spatial_kernel(float *taps, float cutoff) {
+    const int radius = SPATIAL_KERNEL_RADIUS;
+
+    if (cutoff >= 0.5f) {
+        taps[0] = 1.0f;
+        for (int i = 1; i <= radius; i++) {
+            taps[i] = 0.0f;
+        }
+        return;
+    }
+
+    float sum = 0.0f;
+    for (int i = 0; i <= radius; i++) {
+        float sinc = (i == 0) ? 2.0f * cutoff : sinf(2.0f * PI * cutoff * i) / (PI * i);
+        float window = 0.5f * (1.0f + cosf(PI * i / (radius + 1)));
+        taps[i] = sinc * window;
+        sum += (i == 0) ? taps[i] : 2.0f * taps[i];
+    }
+    for (int i = 0; i <= radius; i++) {
+        taps[i] /= sum;
+    }
+}
+
+/**
+ * Convolution horizontale d'une ligne par un noyau symétrique
+ * (src doit être lisible de src - SPATIAL_KERNEL_RADIUS à src + count + SPATIAL_KERNEL_RADIUS)
+ */
+static inline void convolve_row_scalar(const float *src, float *dst, int count, const float *taps) {
+    for (int x = 0; x < count; x++) {
+        float acc = taps[0] * src[x];
+        for (int i = 1; i <= SPATIAL_KERNEL_RADIUS; i++) {
+            acc += taps[i] * (src[x - i] + src[x + i]);
+        }
+        dst[x] = acc;
+    }
+}
+
+/**
+ * Convolution verticale : rows pointe sur les 2 * SPATIAL_KERNEL_RADIUS + 1 lignes
+ * centrées sur la ligne produite
+ */
+static inline void convolve_column_scalar(const float *const *rows, float *dst, int count, const float *taps) {
+    const float *const *center = rows + SPATIAL_KERNEL_RADIUS;
+    for (int x = 0; x < count; x++) {
+        float acc = taps[0] * center[0][x];
+        for (int i = 1; i <= SPATIAL_KERNEL_RADIUS; i++) {
+            acc += taps[i] * (center[-i][x] + center[i][x]);
+        }
+        dst[x] = acc;
+    }
+}
+
+#ifdef __ARM_NEON
+/**
+ * Version NEON de convolve_row_scalar : 4 pixels par itération, les deux échantillons
+ * symétriques étant additionnés avant la multiplication
+ */
+static inline void convolve_row_neon(const float *src, float *dst, int count, const float *taps) {
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        float32x4_t acc = vmulq_n_f32(vld1q_f32(src + x), taps[0]);
+        for (int i = 1; i <= SPATIAL_KERNEL_RADIUS; i++) {
+            acc = vmlaq_n_f32(acc, vaddq_f32(vld1q_f32(src + x - i), vld1q_f32(src + x + i)), taps[i]);
+        }
+        vst1q_f32(dst + x, acc);
+    }
+    convolve_row_scalar(src + x, dst + x, count - x, taps);
+}
+
+/**
+ * Version NEON de convolve_column_scalar
+ */
+static inline void convolve_column_neon(const float *const *rows, float *dst, int count, const float *taps) {
+    const float *const *center = rows + SPATIAL_KERNEL_RADIUS;
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        float32x4_t acc = vmulq_n_f32(vld1q_f32(center[0] + x), taps[0]);
+        for (int i = 1; i <= SPATIAL_KERNEL_RADIUS; i++) {
+            acc = vmlaq_n_f32(acc, vaddq_f32(vld1q_f32(center[-i] + x), vld1q_f32(center[i] + x)), taps[i]);
+        }
+        vst1q_f32(dst + x, acc);
+    }
+    for (; x < count; x++) {
+        float acc = taps[0] * center[0][x];
+        for (int i = 1; i <= SPATIAL_KERNEL_RADIUS; i++) {
+            acc += taps[i] * (center[-i][x] + center[i][x]);
+        }
+        dst[x] = acc;
+    }
+}
+#endif
+
+static inline void convolve_row(const float *src, float *dst, int count, const float *taps) {
+#ifdef __ARM_NEON
+    convolve_row_neon(src, dst, count, taps);
+#else
+    convolve_row_scalar(src, dst, count, taps);
+#endif
+}
+
+static inline void convolve_column(const float *const *rows, float *dst, int count, const float *taps) {
+#ifdef __ARM_NEON
+    convolve_column_neon(rows, dst, count, taps);
+#else
+    convolve_column_scalar(rows, dst, count, taps);
+#endif
+}
+
+/**
+ * Ligne y du moteur spatial filtrée horizontalement, sur les colonnes [x, x + w[
+ * Les colonnes de contexte hors de l'écran sont prises en miroir.
+ * @param line Ligne de travail de w + 2 * SPATIAL_KERNEL_RADIUS floats
+ */
+static void spatial_filtered_row(const unsigned char *fb_data, int width, int line_length,
+                                 int x, int w, int y, const float *taps, const luma_io *io,
+                                 int copy_source, float *line, float *dst) {
+    const int radius = SPATIAL_KERNEL_RADIUS;
+    int c0 = (x - radius < 0) ? 0 : x - radius;
+    int c1 = (x + w + radius > width) ? width : x + w + radius;
+    float *span = line + (c0 - (x - radius));
+
+    if (io && io->gray) {
+        luma_row_from_gray8(&io->gray[y * io->stride + c0], span, c1 - c0);
+    } else {
+        luma_row_from_rgb24(&fb_data[y * line_length + c0 * 3], span, c1 - c0);
+    }
+    if (copy_source) {
+        gray8_row_from_luma(line + radius, &io->gray_copy[y * io->stride + x], w);
+    }
+
+    // Contexte hors de l'écran, en miroir des colonnes déjà lues
+    for (int c = x - radius; c < c0; c++) {
+        line[c - (x - radius)] = line[mirror_index(c, width) - (x - radius)];
+    }
+    for (int c = c1; c < x + w + radius; c++) {
+        line[c - (x - radius)] = line[mirror_index(c, width) - (x - radius)];
+    }
+
+    convolve_row(line + radius, dst, w, taps);
+}
+
+/**
+ * Filtre un rectangle de l'écran par convolution séparable (moteur spatial)
+ *
+ * Le noyau est dérivé des mêmes paramètres que le passe-bas idéal de la FFT : le disque
+ * de rayon largeur / param_radius_max_diviser (en fréquences de l'écran) coupe à
+ * 1 / param_radius_max_diviser cycle par pixel horizontalement et à
+ * largeur / (param_radius_max_diviser * hauteur) verticalement. Le noyau séparable en
+ * fait un rectangle, dont la coupure est adoucie par la fenêtre de Hann.
+ *
+ * Chaque thread traite une bande de lignes en flux : les lignes filtrées horizontalement
+ * restent dans un anneau de 2 * SPATIAL_KERNEL_RADIUS + 1 lignes. Les lignes de contexte
+ * partagées avec les bandes voisines (qui les réécrivent) sont lues avant une barrière.
+ * Le contexte est lu autour du rectangle dans le framebuffer (ou io->gray), et pris en
+ * miroir aux bords de l'écran uniquement.
+ *
+ * @param tolerance Tolérance de détection de couleur, vérifiée sur le rectangle avant
+ *        la première écriture (négative : pas de détection)
+ * @param io Lecture et copies de la luminance 8 bits, relatives au premier pixel de
+ *        l'écran (mode incrémental), NULL : aucune
+ * @return 0 en cas de succès, 1 si le rectangle contient de la couleur (laissé intact),
+ *         -1 en cas d'erreur
+ */
+static int filter_region_spatial(unsigned char *fb_data, int width, int height, int line_length,
+                                 int x, int y, int w, int h, float param_radius_max_diviser,
+                                 int tolerance, const luma_io *io) {
+    const int radius = SPATIAL_KERNEL_RADIUS;
+    const int ring_rows = 2 * radius + 1;
+    const int threads = omp_get_max_threads();
+    const size_t thread_floats = (size_t)(ring_rows + radius) * w + w + 2 * radius;
+    double frame_start = omp_get_wtime();
+    int found_colored = 0;
+
+    float taps_x[SPATIAL_KERNEL_RADIUS + 1], taps_y[SPATIAL_KERNEL_RADIUS + 1];
+    float radius_max = width / param_radius_max_diviser;
+    build_spatial_kernel(taps_x, radius_max / width);
+    build_spatial_kernel(taps_y, radius_max / height);
+
+    float *work = malloc(sizeof(float) * thread_floats * threads);
+    if (!work) {
+        return -1;
+    }
+    account_alloc(sizeof(float) * thread_floats * threads);
+
+    // Détection de couleur sur tout le rectangle avant d'écrire quoi que ce soit
+    if (tolerance >= 0 && !(io && io->gray)) {
+        #pragma omp parallel num_threads(threads)
+        {
+            float *row = work + omp_get_thread_num() * thread_floats;
+            int y0, y1;
+            thread_row_band(h, &y0, &y1);
+            for (int j = y0; j < y1; j++) {
+                int stop;
+                #pragma omp atomic read
+                stop = found_colored;
+                if (stop) {
+                    break;
+                }
+                if (luma_row_from_rgb24_detect(&fb_data[(y + j) * line_length + x * 3], row, w, tolerance)) {
+                    #pragma omp atomic write
+                    found_colored = 1;
+                    break;
+                }
+            }
+        }
+    }
+    g_stage_ms[MOIRE_STAGE_LOAD] = (omp_get_wtime() - frame_start) * 1000.0;
+
+    if (found_colored) {
+        account_free(sizeof(float) * thread_floats * threads);
+        free(work);
+        return 1;
+    }
+
+    double start = omp_get_wtime();
+    const int first_row = (y - radius < 0) ? 0 : y - radius;
+    const int last_row = (y + h + radius > height) ? height : y + h + radius;
+
+    #pragma omp parallel num_threads(threads)
+    {
+        float *ring = work + omp_get_thread_num() * thread_floats;
+        float *tail = ring + (size_t)ring_rows * w;
+        float *line = tail + (size_t)radius * w;
+        const float *rows[2 * SPATIAL_KERNEL_RADIUS + 1];
+        int y0, y1;
+        thread_row_band(h, &y0, &y1);
+        y0 += y;
+        y1 += y;
+
+        // Contexte partagé avec les bandes voisines : au-dessus dans l'anneau, en dessous à part
+        for (int r = (y0 - radius < first_row) ? first_row : y0 - radius; r < y0; r++) {
+            spatial_filtered_row(fb_data, width, line_length, x, w, r, taps_x, io, 0,
+                                 line, ring + (r % ring_rows) * w);
+        }
+        for (int r = y1; r < y1 + radius && r < last_row; r++) {
+            spatial_filtered_row(fb_data, width, line_length, x, w, r, taps_x, io, 0,
+                                 line, tail + (r - y1) * w);
+        }
+        #pragma omp barrier
+
+        int next = y0;
+        for (int j = y0; j < y1; j++) {
+            // Lignes de la bande nécessaires à la ligne j
+            for (; next < y1 && next <= j + radius; next++) {
+                spatial_filtered_row(fb_data, width, line_length, x, w, next, taps_x, io,
+                                     io && io->gray_copy, line, ring + (next % ring_rows) * w);
+            }
+            for (int i = -radius; i <= radius; i++) {
+                int r = mirror_index(j + i, height);
+                rows[i + radius] = (r < y1) ? ring + (r % ring_rows) * w : tail + (r - y1) * w;
+            }
+
+            unsigned char *dst = &fb_data[j * line_length + x * 3];
+            convolve_column(rows, line, w, taps_y);
+            rgb24_row_from_luma(line, dst, w, 1.0f);
+            if (io && io->out_copy) {
+                gray8_row_from_rgb24(dst, &io->out_copy[j * io->stride + x], w);
+            }
+        }
+    }
+
+    account_free(sizeof(float) * thread_floats * threads);
+    free(work);
+
+    g_stage_ms[MOIRE_STAGE_FFT] = 0.0;
+    g_stage_ms[MOIRE_STAGE_FILTER] = (omp_get_wtime() - start) * 1000.0;
+    g_stage_ms[MOIRE_STAGE_IFFT] = 0.0;
+    g_stage_ms[MOIRE_STAGE_STORE] = 0.0;
+    g_stage_ms[MOIRE_STAGE_TOTAL] = (omp_get_wtime() - frame_start) * 1000.0;
+    return 0;
+}
+
+/**
+ * Le moteur spatial ne reproduit que le passe-bas pur (param_radius_min au moins égal
+ * au rayon maximal, configuration de production)
+ */
+static inline int spatial_engine_applies(int width, float param_radius_min, float param_radius_max_diviser) {
+    return param_radius_min >= width / param_radius_max_diviser;
+}
+
+/**
+ * Coefficients du filtre de décimation d'un facteur entier : noyau triangulaire de
+ * demi-largeur factor centré sur le bloc (convolution de deux moyennes par blocs),
+ * normalisé. Le pixel réduit s couvre les colonnes s * factor + first + k.
+ * @param taps Sortie : au plus 2 * MOIRE_DECIMATION_MAX coefficients
+ * @param first Sortie : décalage de la première colonne
+ * @return Nombre de coefficients
+ */
+static int decimation_taps(int factor, float *taps, int *first) {
+    int count = 0;
+    *first = 0;
+    for (int j = -factor; j < 2 * factor; j++) {
+        float distance = fabsf(j + 0.5f - 0.5f * factor);
+        if (distance < factor) {
+            if (count == 0) {
+                *first = j;
+            }
+            taps[count++] = (factor - distance) / (factor * factor);
+        }
+    }
+    return count;
+}
+
+/**
+ * Étendue réduite et origine de la fenêtre de décimation dans une dimension
+ * Une région couvrant tout l'écran, ou trop large pour les classes de taille, est
+ * traitée d'un seul bloc depuis l'origine (le dernier bloc peut dépasser de l'écran).
+ * @param pos Début de la région
+ * @param len Longueur de la région
+ * @param size Taille de l'écran dans cette dimension
+ * @param small Sortie : nombre de pixels réduits
+ * @param origin Sortie : début de la fenêtre (pixels pleine résolution)
+ */
+static void decimated_span(int pos, int len, int size, int margin, int factor, int *small, int *origin) {
+    int count = rect_size_class((len + 2 * margin + factor - 1) / factor, size / factor);
+    if (len == size || count * factor < len) {
+        *small = (size + factor - 1) / factor;
+        *origin = 0;
+        return;
+    }
+    int start = pos + len / 2 - count * factor / 2;
+    *small = count;
+    *origin = (start < 0) ? 0 : ((start > size - count * factor) ? size - count * factor : start);
+}
+
+/**
+ * Le filtre appliqué à l'écran réduit d'un facteur ne modifie aucune fréquence : passe-bas
+ * pur dont le disque couvre tout le spectre réduit (jusqu'à ses coins). C'est le cas de
+ * la configuration de production dès le facteur 2 : la fréquence de coupure, en cycles
+ * par pixel réduit, vaut factor / param_radius_max_diviser (la coupure de la pleine
+ * résolution), au-delà de la fréquence radiale maximale √2 / 2 ; seule la décimation
+ * atténue alors les hautes fréquences.
+ * @param ref_width Largeur de l'écran réduit
+ * @param ref_height Hauteur de l'écran réduit
+ */
+static int decimated_filter_is_identity(int ref_width, int ref_height, int factor,
+                                        float param_radius_min, float param_radius_max_diviser) {
+    float radius_max = ref_width / (param_radius_max_diviser / factor);
+    float corner_x = 0.5f * ref_width, corner_y = 0.5f * ref_height;
+    return param_radius_min >= radius_max &&
+           radius_max * radius_max >= corner_x * corner_x + corner_y * corner_y;
+}
+
+/**
+ * Filtre une région à résolution réduite d'un facteur entier
+ *
+ * La luminance de la fenêtre (région et marge de contexte) est décimée par un filtre
+ * triangulaire séparable, qui atténue les fréquences repliées bien mieux qu'une simple
+ * moyenne par blocs, puis transformée et filtrée à cette échelle (factor² fois moins de
+ * points). La sortie est interpolée (linéaire séparable) ligne par ligne pendant
+ * l'écriture RGB24, sans plan pleine résolution intermédiaire.
+ *
+ * Les rayons gardent la coupure spatiale de la pleine résolution : une case de la
+ * référence réduite (diviseur divisé par factor) vaut une case de l'écran entier, d'où
+ * le rayon minimal inchangé. L'image plus douce vient de la décimation triangulaire et
+ * de l'interpolation linéaire. Quand ce filtre ne modifie aucune fréquence réduite
+ * (decimated_filter_is_identity), la transformée est sautée : le plan décimé est
+ * agrandi tel quel, sans plans FFTW.
+ *
+ * @param margin Marge de contexte autour de la région (pixels pleine résolution)
+ * @param factor Facteur de réduction (2 à MOIRE_DECIMATION_MAX)
+ * @param tolerance Tolérance de détection de couleur (négative : pas de détection)
+ * @param io Lecture et copies de la luminance 8 bits, relatives au premier pixel de
+ *        l'écran (mode incrémental), NULL : aucune
+ * @return 0 en cas de succès, 1 si la région contient de la couleur (laissée intacte),
+ *         -1 en cas d'erreur
+ */
+static int filter_region_decimated(unsigned char *fb_data, int width, int height, int line_length,
+                                   int x, int y, int w, int h, int margin, int factor,
+                                   float param_radius_min, float param_radius_max_diviser,
+                                   int tolerance, const luma_io *io) {
+    double frame_start = omp_get_wtime();
+    int small_w, small_h, win_x, win_y;
+
+    decimated_span(x, w, width, margin, factor, &small_w, &win_x);
+    decimated_span(y, h, height, margin, factor, &small_h, &win_y);
+
+    // Plan décimé : entrée de la transformée, ou plan simple si le filtre est sans effet
+    fftw_resources *res = NULL;
+    float *plane;
+    int plane_stride;
+    size_t plane_bytes = 0;
+    if (decimated_filter_is_identity(width / factor, height / factor, factor,
+                                     param_radius_min, param_radius_max_diviser)) {
+        plane_stride = small_w;
+        plane_bytes = sizeof(float) * small_w * small_h;
+        plane = malloc(plane_bytes);
+        if (!plane) {
+            return -1;
+        }
+        account_alloc(plane_bytes);
+    } else {
+        res = acquire_rect_resources(small_w, small_h, g_pad_mode);
+        if (!res || (!res->fft_input_tmp && allocate_fftw_buffers(res) != 0)) {
+            return -1;
+        }
+        plane = res->fft_input_tmp;
+        plane_stride = res->real_stride;
+    }
+
+    float taps[2 * MOIRE_DECIMATION_MAX];
+    int first;
+    const int tap_count = decimation_taps(factor, taps, &first);
+
+    // Ligne de travail par thread : colonnes lues pour la décimation (qui couvrent aussi
+    // la ligne agrandie), puis ligne réduite interpolée et ses deux bords
+    const int line_floats = (small_w - 1) * factor + tap_count;
+    const size_t thread_floats = (size_t)line_floats + small_w + 2;
+    const int threads = omp_get_max_threads();
+    float *work = malloc(sizeof(float) * thread_floats * threads);
+    if (!work) {
+        if (plane_bytes) {
+            account_free(plane_bytes);
+            free(plane);
+        }
+        return -1;
+    }
+    account_alloc(sizeof(float) * thread_floats * threads);
+
+    // Décimation : chaque ligne réduite cumule tap_count lignes décimées horizontalement
+    double start = omp_get_wtime();
+    const int pad_rows = res ? res->height - res->image_height : 0;
+    const int col0 = win_x + first;
+    const int read_x0 = (col0 < 0) ? 0 : col0;
+    const int read_x1 = (col0 + line_floats > width) ? width : col0 + line_floats;
+    const int detect = tolerance >= 0 && !(io && io->gray);
+    int found_colored = 0;
+    #pragma omp parallel num_threads(threads)
+    {
+        float *line = work + omp_get_thread_num() * thread_floats;
+        int y0, y1;
+        thread_row_band(small_h, &y0, &y1);
+        for (int sy = y0; sy < y1; sy++) {
+            float *row = &plane[sy * plane_stride];
+            memset(row, 0, sizeof(float) * small_w);
+            for (int ty = 0; ty < tap_count; ty++) {
+                int stop;
+                #pragma omp atomic read
+                stop = found_colored;
+                if (stop) {
+                    break;
+                }
+
+                // Ligne source, les colonnes et lignes hors de l'écran répétant le bord
+                int src_y = win_y + sy * factor + first + ty;
+                src_y = (src_y < 0) ? 0 : ((src_y >= height) ? height - 1 : src_y);
+                float *dst = line + (read_x0 - col0);
+                if (io && io->gray) {
+                    luma_row_from_gray8(&io->gray[src_y * io->stride + read_x0], dst, read_x1 - read_x0);
+                } else if (detect) {
+                    if (luma_row_from_rgb24_detect(&fb_data[src_y * line_length + read_x0 * 3], dst,
+                                                   read_x1 - read_x0, tolerance)) {
+                        #pragma omp atomic write
+                        found_colored = 1;
+                        break;
+                    }
+                } else {
+                    luma_row_from_rgb24(&fb_data[src_y * line_length + read_x0 * 3], dst, read_x1 - read_x0);
+                }
+                for (int i = 0; i < read_x0 - col0; i++) {
+                    line[i] = dst[0];
+                }
+                for (int i = read_x1 - col0; i < line_floats; i++) {
+                    line[i] = line[read_x1 - col0 - 1];
+                }
+
+                for (int sx = 0; sx < small_w; sx++) {
+                    const float *src = line + sx * factor;
+                    float acc = 0.0f;
+                    for (int k = 0; k < tap_count; k++) {
+                        acc += taps[k] * src[k];
+                    }
+                    row[sx] += taps[ty] * acc;
+                }
+            }
+            if (res && res->width > small_w) {
+                pad_luma_row(res, row);
+            }
+        }
+        if (pad_rows > 0) {
+            #pragma omp barrier
+            thread_row_band(pad_rows, &y0, &y1);
+            for (int sy = y0; sy < y1; sy++) {
+                pad_luma_bottom_row(res, small_h + sy);
+            }
+        }
+    }
+    g_stage_ms[MOIRE_STAGE_LOAD] = (omp_get_wtime() - start) * 1000.0;
+
+    int status = found_colored ? 1 : 0;
+    const float *output = plane;
+    float norm_factor = 1.0f;
+    g_stage_ms[MOIRE_STAGE_FFT] = 0.0;
+    g_stage_ms[MOIRE_STAGE_FILTER] = 0.0;
+    g_stage_ms[MOIRE_STAGE_IFFT] = 0.0;
+    if (status == 0 && res) {
+        start = omp_get_wtime();
+        fftwf_execute_dft_r2c(res->fft2d_plan, res->fft_input_tmp, res->fft_result);
+        g_stage_ms[MOIRE_STAGE_FFT] = (omp_get_wtime() - start) * 1000.0;
+
+        // Référence : l'écran réduit, dont les cases valent celles de l'écran entier :
+        // même coupure spatiale qu'à pleine résolution
+        start = omp_get_wtime();
+        if (filter_spectrum_for_kaleido(res, res->fft_result, width / factor, height / factor,
+                                        param_radius_min, param_radius_max_diviser / factor) != 0) {
+            status = -1;
+        }
+        g_stage_ms[MOIRE_STAGE_FILTER] = (omp_get_wtime() - start) * 1000.0;
+
+        start = omp_get_wtime();
+        if (status == 0) {
+            fftwf_execute_dft_c2r(res->ifft2d_plan, res->fft_result, res->ifft_result);
+        }
+        g_stage_ms[MOIRE_STAGE_IFFT] = (omp_get_wtime() - start) * 1000.0;
+        output = res->ifft_result;
+        norm_factor = 1.0f / (res->width * res->height);
+    }
+    if (status != 0) {
+        account_free(sizeof(float) * thread_floats * threads);
+        free(work);
+        if (plane_bytes) {
+            account_free(plane_bytes);
+            free(plane);
+        }
+        return status;
+    }
+
+    // Interpolation entre les centres des blocs : verticale sur la ligne réduite, puis
+    // horizontale vers la ligne de travail, écrite aussitôt en RGB24
+    start = omp_get_wtime();
+    #pragma omp parallel num_threads(threads)
+    {
+        float *line = work + omp_get_thread_num() * thread_floats;
+        float *small = line + line_floats + 1;
+        int y0, y1;
+        thread_row_band(h, &y0, &y1);
+        for (int py = y + y0; py < y + y1; py++) {
+            float fy = (py - win_y + 0.5f) / factor - 0.5f;
+            fy = (fy < 0.0f) ? 0.0f : ((fy > small_h - 1) ? (float)(small_h - 1) : fy);
+            int sy0 = (int)fy;
+            int sy1 = (sy0 + 1 < small_h) ? sy0 + 1 : sy0;
+            unsigned char *dst = fb_data + (size_t)py * line_length + x * 3;
+
+            // Copie de la source avant de la remplacer
+            if (io && io->gray_copy) {
+                luma_row_from_rgb24(dst, line, w);
+                gray8_row_from_luma(line, &io->gray_copy[py * io->stride + x], w);
+            }
+
+            blend_rows(&output[sy0 * plane_stride], &output[sy1 * plane_stride], small, small_w, fy - sy0);
+            small[-1] = small[0];
+            small[small_w] = small[small_w - 1];
+            upsample_row(small, line, small_w, factor);
+
+            rgb24_row_from_luma(line + (x - win_x), dst, w, norm_factor);
+            if (io && io->out_copy) {
+                gray8_row_from_rgb24(dst, &io->out_copy[py * io->stride + x], w);
+            }
+        }
+    }
+    account_free(sizeof(float) * thread_floats * threads);
+    free(work);
+    if (plane_bytes) {
+        account_free(plane_bytes);
+        free(plane);
+    }
+
+    g_stage_ms[MOIRE_STAGE_STORE] = (omp_get_wtime() - start) * 1000.0;
+    g_stage_ms[MOIRE_STAGE_TOTAL] = (omp_get_wtime() - frame_start) * 1000.0;
+    return 0;
+}
+
+/**
+ * Filtre l'écran complet avec le moteur sélectionné (set_moire_engine) ; le moteur
+ * spatial laisse la place au moteur complet hors de la configuration passe-bas pur
+ * @return 0 en cas de succès, 1 si l'image contient de la couleur, -1 en cas d'erreur
+ */
+static int filter_screen(unsigned char *fb_data, int width, int height, int line_length,
+                         float param_radius_min, float param_radius_max_diviser, int tolerance,
+                         const luma_io *io) {
+    if (g_engine == MOIRE_ENGINE_TILED) {
+        return filter_frame_tiled(fb_data, width, height, line_length,
+                                  param_radius_min, param_radius_max_diviser, tolerance, io);
+    }
+    if (g_engine == MOIRE_ENGINE_SPATIAL && spatial_engine_applies(width, param_radius_min, param_radius_max_diviser)) {
+        return filter_region_spatial(fb_data, width, height, line_length, 0, 0, width, height,
+                                     param_radius_max_diviser, tolerance, io);
+    }
+
+    if (g_decimation > 1) {
+        return filter_region_decimated(fb_data, width, height, line_length, 0, 0, width, height, 0,
+                                       g_decimation, param_radius_min, param_radius_max_diviser,
+                                       tolerance, io);
+    }
+
+    // Initialiser ou réutiliser les ressources FFTW
+    if (init_fftw_resources(width, height, line_length, g_pad_mode) != 0) {
+        fprintf(stderr, "Erreur d'initialisation des ressources FFTW\n");
+        return -1;
+    }
+    return filter_window(&g_screen->full, fb_data, line_length, width, height, 0, 0, width, height,
+                         param_radius_min, param_radius_max_diviser, tolerance, NULL, io);
+}
+
+// Constantes de xxHash32
+#define HASH_PRIME1 2654435761u
+#define HASH_PRIME2 2246822519u
+#define HASH_PRIME3 3266489917u
+#define HASH_PRIME4 668265263u
+#define HASH_PRIME5 374761393u
+
+static inline uint32_t hash_rotl(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/**
+ * Empreinte d'une tuile du framebuffer, dans l'esprit de xxHash32 : 4 accumulateurs
+ * indépendants consomment 16 octets par tour (un vecteur NEON), les octets de fin de
+ * ligne passent par un accumulateur scalaire. Il ne s'agit pas du xxHash32 standard
+ * (la tuile n'est pas contiguë en mémoire), seulement d'un hachage rapide et bien mélangé.
+ */
+static uint32_t hash_tile(const unsigned char *data, int line_length,
+                          int x0, int y0, int w, int h) {
+    const int row_bytes = w * 3;
+    uint32_t tail = HASH_PRIME5;
+
+    const uint32_t seed[4] = { HASH_PRIME1 + HASH_PRIME2, HASH_PRIME2, 0, 0u - HASH_PRIME1 };
+#ifdef __ARM_NEON
+    uint32x4_t acc = vld1q_u32(seed);
+    const uint32x4_t prime1 = vdupq_n_u32(HASH_PRIME1);
+    const uint32x4_t prime2 = vdupq_n_u32(HASH_PRIME2);
+#else
+    uint32_t acc[4];
+    memcpy(acc, seed, sizeof(acc));
+#endif
+
+    for (int y = y0; y < y0 + h; y++) {
+        const unsigned char *row = data + (size_t)y * line_length + x0 * 3;
+        int i = 0;
+
+        for (; i + 16 <= row_bytes; i += 16) {
+#ifdef __ARM_NEON
+            uint32x4_t lanes = vreinterpretq_u32_u8(vld1q_u8(row + i));
+            acc = vmlaq_u32(acc, lanes, prime2);
+            acc = vorrq_u32(vshlq_n_u32(acc, 13), vshrq_n_u32(acc, 19));
+            acc = vmulq_u32(acc, prime1);
+#else
+            uint32_t lanes[4];
+            memcpy(lanes, row + i, 16);
+            for (int k = 0; k < 4; k++) {
+                acc[k] = hash_rotl(acc[k] + lanes[k] * HASH_PRIME2, 13) * HASH_PRIME1;
+            }
+#endif
+        }
+
+        for (; i < row_bytes; i++) {
+            tail = hash_rotl(tail + row[i] * HASH_PRIME5, 11) * HASH_PRIME1;
+        }
+    }
+
+#ifdef __ARM_NEON
+    uint32_t lanes[4];
+    vst1q_u32(lanes, acc);
+#else
+    uint32_t *lanes = acc;
+#endif
+    uint32_t hash = hash_rotl(lanes[0], 1) + hash_rotl(lanes[1], 7) +
+                    hash_rotl(lanes[2], 12) + hash_rotl(lanes[3], 18);
+    hash ^= tail + (uint32_t)(w * h);
+
+    // Mélange final (avalanche)
+    hash ^= hash >> 15;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 13;
+    hash *= HASH_PRIME3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * Empreinte 64 bits de l'écran complet : bandes de FRAME_HASH_TILE lignes hachées en
+ * parallèle, combinées avec leur rang (indépendant du nombre de threads)
+ */
+static uint64_t hash_frame(const unsigned char *fb_data, int line_length, int width, int height) {
+    const int bands = (height + FRAME_HASH_TILE - 1) / FRAME_HASH_TILE;
+    uint64_t key = (uint64_t)width << 32 | (uint32_t)height;
+
+    #pragma omp parallel for reduction(^:key)
+    for (int band = 0; band < bands; band++) {
+        int y = band * FRAME_HASH_TILE;
+        int h = (y + FRAME_HASH_TILE < height) ? FRAME_HASH_TILE : height - y;
+        // Mélange splitmix64 du rang et de l'empreinte de la bande
+        uint64_t z = ((uint64_t)band << 32 | hash_tile(fb_data, line_length, 0, y, width, h)) +
+                     0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        key ^= z ^ (z >> 31);
+    }
+    return key;
+}
+
+/**
+ * Compare les tuiles couvrant un rectangle aux empreintes de la dernière image produite
+ * Les tuiles dont le contenu a changé sont invalidées. La comparaison s'arrête dès
+ * qu'une tuile diffère, sauf si update_all est demandé (invalidation complète).
+ * @return 1 si toutes les tuiles du rectangle sont identiques à la dernière sortie, 0 sinon
+ */
+static int frame_tiles_unchanged(const unsigned char *fb_data, int x, int y, int w, int h,
+                                 int update_all) {
+    const int tx0 = x / FRAME_HASH_TILE, tx1 = (x + w - 1) / FRAME_HASH_TILE;
+    const int ty0 = y / FRAME_HASH_TILE, ty1 = (y + h - 1) / FRAME_HASH_TILE;
+    const int count_x = tx1 - tx0 + 1;
+    const int count = count_x * (ty1 - ty0 + 1);
+    int changed = 0;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < count; i++) {
+        int stop;
+        #pragma omp atomic read
+        stop = changed;
+        if (stop && !update_all) {
+            continue;
+        }
+
+        int tile = (ty0 + i / count_x) * g_frame.tiles_x + tx0 + i % count_x;
+        if (!g_frame.valid[tile]) {
+            #pragma omp atomic write
+            changed = 1;
+            continue;
+        }
+
+        int px = (tile % g_frame.tiles_x) * FRAME_HASH_TILE;
+        int py = (tile / g_frame.tiles_x) * FRAME_HASH_TILE;
+        int pw = (px + FRAME_HASH_TILE < g_frame.width) ? FRAME_HASH_TILE : g_frame.width - px;
+        int ph = (py + FRAME_HASH_TILE < g_frame.height) ? FRAME_HASH_TILE : g_frame.height - py;
+        if (hash_tile(fb_data, g_frame.line_length, px, py, pw, ph) != g_frame.hashes[tile]) {
+            g_frame.valid[tile] = 0;
+            #pragma omp atomic write
+            changed = 1;
+        }
+    }
+
+    return !changed;
+}
+
+/**
+ * Vérifie si un rectangle est identique à la dernière image produite : soit c'est
+ * exactement le dernier rectangle filtré (rafraîchissement répété), soit toutes les
+ * tuiles qu'il touche sont inchangées
+ * @return 1 si identique, 0 sinon
+ */
+static int frame_rect_unchanged(const unsigned char *fb_data, int x, int y, int w, int h) {
+    if (g_frame.rect_w > 0 && x == g_frame.rect_x && y == g_frame.rect_y &&
+        w == g_frame.rect_w && h == g_frame.rect_h &&
+        hash_tile(fb_data, g_frame.line_length, x, y, w, h) == g_frame.rect_hash) {
+        return 1;
+    }
+    return frame_tiles_unchanged(fb_data, x, y, w, h, 1);
+}
+
+/**
+ * Enregistre les empreintes des tuiles couvrant un rectangle qui vient d'être écrit
+ * Une tuile entièrement couverte devient valide ; une tuile partiellement couverte ne
+ * l'est que si le reste de son contenu était déjà la dernière sortie (tuile encore valide).
+ */
+static void record_frame_tiles(const unsigned char *fb_data, int x, int y, int w, int h) {
+    const int tx0 = x / FRAME_HASH_TILE, tx1 = (x + w - 1) / FRAME_HASH_TILE;
+    const int ty0 = y / FRAME_HASH_TILE, ty1 = (y + h - 1) / FRAME_HASH_TILE;
+    const int count_x = tx1 - tx0 + 1;
+    const int count = count_x * (ty1 - ty0 + 1);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < count; i++) {
+        int tile = (ty0 + i / count_x) * g_frame.tiles_x + tx0 + i % count_x;
+        int px = (tile % g_frame.tiles_x) * FRAME_HASH_TILE;
+        int py = (tile / g_frame.tiles_x) * FRAME_HASH_TILE;
+        int pw = (px + FRAME_HASH_TILE < g_frame.width) ? FRAME_HASH_TILE : g_frame.width - px;
+        int ph = (py + FRAME_HASH_TILE < g_frame.height) ? FRAME_HASH_TILE : g_frame.height - py;
+        int covered = px >= x && py >= y && px + pw <= x + w && py + ph <= y + h;
+
+        if (covered || g_frame.valid[tile]) {
+            g_frame.hashes[tile] = hash_tile(fb_data, g_frame.line_length, px, py, pw, ph);
+            g_frame.valid[tile] = 1;
+        }
+    }
+
+    // Les tuiles partiellement couvertes peuvent rester invalides : l'empreinte exacte
+    // du rectangle permet de reconnaître malgré tout un rafraîchissement répété
+    g_frame.rect_x = x;
+    g_frame.rect_y = y;
+    g_frame.rect_w = w;
+    g_frame.rect_h = h;
+    g_frame.rect_hash = hash_tile(fb_data, g_frame.line_length, x, y, w, h);
+}
+
+/**
+ * Vérifie si l'écran complet est identique à la dernière image produite
+ * @return 1 si identique, 0 sinon (ou si les empreintes ne peuvent pas être allouées)
+ */
+static int frame_unchanged(const unsigned char *fb_data, int width, int height, int line_length) {
+    if (prepare_frame_hashes(width, height, line_length) != 0) {
+        return 0;
+    }
+    return frame_tiles_unchanged(fb_data, 0, 0, width, height, 0);
+}
+
+/**
+ * Enregistre l'écran complet comme dernière image produite
+ */
+static void record_frame(const unsigned char *fb_data, int width, int height, int line_length) {
+    if (prepare_frame_hashes(width, height, line_length) != 0) {
+        return;
+    }
+    memset(g_frame.valid, 1, g_frame.tiles_x * g_frame.tiles_y);
+    record_frame_tiles(fb_data, 0, 0, width, height);
+}
+
+/**
+ * Libère les brouillons (leurs tuiles gardent le contenu réduit)
+ */
+static void release_draft_frame() {
+    free(g_draft.source);
+    free(g_draft.hashes);
+    free(g_draft.valid);
+    account_free(g_draft.bytes);
+    memset(&g_draft, 0, sizeof(g_draft));
+}
+
+/**
+ * Prépare les brouillons pour la géométrie du framebuffer (grille de FRAME_HASH_TILE pixels)
+ * @return 0 en cas de succès, -1 en cas d'erreur d'allocation
+ */
+static int prepare_draft_frame(int width, int height, int line_length) {
+    if (g_draft.source && g_draft.width == width && g_draft.height == height &&
+        g_draft.line_length == line_length) {
+        return 0;
+    }
+
+    release_draft_frame();
+    int tiles_x = (width + FRAME_HASH_TILE - 1) / FRAME_HASH_TILE;
+    int tiles_y = (height + FRAME_HASH_TILE - 1) / FRAME_HASH_TILE;
+    g_draft.source = malloc((size_t)width * height);
+    g_draft.hashes = malloc(sizeof(uint32_t) * tiles_x * tiles_y);
+    g_draft.valid = calloc(tiles_x * tiles_y, 1);
+    if (!g_draft.source || !g_draft.hashes || !g_draft.valid) {
+        release_draft_frame();
+        return -1;
+    }
+    g_draft.bytes = (size_t)width * height + (sizeof(uint32_t) + 1) * tiles_x * tiles_y;
+    account_alloc(g_draft.bytes);
+
+    g_draft.width = width;
+    g_draft.height = height;
+    g_draft.line_length = line_length;
+    g_draft.tiles_x = tiles_x;
+    g_draft.tiles_y = tiles_y;
+    return 0;
+}
+
+/**
+ * Rectangle d'une tuile des brouillons
+ */
+static void draft_tile_rect(int tile, int *px, int *py, int *pw, int *ph) {
+    *px = (tile % g_draft.tiles_x) * FRAME_HASH_TILE;
+    *py = (tile / g_draft.tiles_x) * FRAME_HASH_TILE;
+    *pw = (*px + FRAME_HASH_TILE < g_draft.width) ? FRAME_HASH_TILE : g_draft.width - *px;
+    *ph = (*py + FRAME_HASH_TILE < g_draft.height) ? FRAME_HASH_TILE : g_draft.height - *py;
+}
+
+/**
+ * Garde la source des tuiles touchées par un rectangle avant d'y écrire un brouillon
+ * Une tuile qui montre encore son brouillon précédent garde la source d'origine.
+ */
+static void save_draft_sources(const unsigned char *fb_data, int x, int y, int w, int h) {
+    const int tx0 = x / FRAME_HASH_TILE, tx1 = (x + w - 1) / FRAME_HASH_TILE;
+    const int ty0 = y / FRAME_HASH_TILE, ty1 = (y + h - 1) / FRAME_HASH_TILE;
+    const int count_x = tx1 - tx0 + 1;
+    const int count = count_x * (ty1 - ty0 + 1);
+    int added = 0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:added)
+    for (int i = 0; i < count; i++) {
+        int tile = (ty0 + i / count_x) * g_draft.tiles_x + tx0 + i % count_x;
+        int px, py, pw, ph;
+        draft_tile_rect(tile, &px, &py, &pw, &ph);
+        if (g_draft.valid[tile] &&
+            hash_tile(fb_data, g_draft.line_length, px, py, pw, ph) == g_draft.hashes[tile]) {
+            continue;
+        }
+
+        float row[FRAME_HASH_TILE];
+        for (int ty = py; ty < py + ph; ty++) {
+            luma_row_from_rgb24(fb_data + (size_t)ty * g_draft.line_length + px * 3, row, pw);
+            gray8_row_from_luma(row, &g_draft.source[(size_t)ty * g_draft.width + px], pw);
+        }
+        added += !g_draft.valid[tile];
+        g_draft.valid[tile] = 1;
+    }
+    g_draft.count += added;
+}
+
+/**
+ * Enregistre le brouillon écrit dans les tuiles touchées par un rectangle : elles ne
+ * comptent plus comme dernière image produite, pour que le rafraîchissement complet
+ * suivant les refiltre en pleine qualité
+ */
+static void record_draft_tiles(const unsigned char *fb_data, int x, int y, int w, int h) {
+    const int tx0 = x / FRAME_HASH_TILE, tx1 = (x + w - 1) / FRAME_HASH_TILE;
+    const int ty0 = y / FRAME_HASH_TILE, ty1 = (y + h - 1) / FRAME_HASH_TILE;
+    const int count_x = tx1 - tx0 + 1;
+    const int count = count_x * (ty1 - ty0 + 1);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < count; i++) {
+        int tile = (ty0 + i / count_x) * g_draft.tiles_x + tx0 + i % count_x;
+        int px, py, pw, ph;
+        draft_tile_rect(tile, &px, &py, &pw, &ph);
+        g_draft.hashes[tile] = hash_tile(fb_data, g_draft.line_length, px, py, pw, ph);
+        if (g_frame.valid && g_frame.width == g_draft.width && g_frame.height == g_draft.height) {
+            g_frame.valid[tile] = 0;
+        }
+    }
+    g_frame.rect_w = 0;
+}
+
+/**
+ * Vérifie si toutes les tuiles touchées par un rectangle montrent encore leur brouillon
+ * (rafraîchissement rapide répété sur le même contenu)
+ */
+static int draft_rect_unchanged(const unsigned char *fb_data, int x, int y, int w, int h) {
+    if (!g_draft.count) {
+        return 0;
+    }
+    for (int ty = y / FRAME_HASH_TILE; ty <= (y + h - 1) / FRAME_HASH_TILE; ty++) {
+        for (int tx = x / FRAME_HASH_TILE; tx <= (x + w - 1) / FRAME_HASH_TILE; tx++) {
+            int tile = ty * g_draft.tiles_x + tx;
+            int px, py, pw, ph;
+            draft_tile_rect(tile, &px, &py, &pw, &ph);
+            if (!g_draft.valid[tile] ||
+                hash_tile(fb_data, g_draft.line_length, px, py, pw, ph) != g_draft.hashes[tile]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Remet la source dans les tuiles touchées par un rectangle qui montrent encore leur
+ * brouillon, avant un filtrage pleine qualité (les autres tuiles ont reçu un nouveau
+ * contenu et ne sont plus des brouillons)
+ */
+static void restore_draft_sources(unsigned char *fb_data, int width, int height, int line_length,
+                                  int x, int y, int w, int h) {
+    if (!g_draft.count || g_draft.width != width || g_draft.height != height ||
+        g_draft.line_length != line_length) {
+        return;
+    }
+
+    const int tx0 = x / FRAME_HASH_TILE, tx1 = (x + w - 1) / FRAME_HASH_TILE;
+    const int ty0 = y / FRAME_HASH_TILE, ty1 = (y + h - 1) / FRAME_HASH_TILE;
+    const int count_x = tx1 - tx0 + 1;
+    const int count = count_x * (ty1 - ty0 + 1);
+    int removed = 0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:removed)
+    for (int i = 0; i < count; i++) {
+        int tile = (ty0 + i / count_x) * g_draft.tiles_x + tx0 + i % count_x;
+        if (!g_draft.valid[tile]) {
+            continue;
+        }
+        int px, py, pw, ph;
+        draft_tile_rect(tile, &px, &py, &pw, &ph);
+        if (hash_tile(fb_data, line_length, px, py, pw, ph) == g_draft.hashes[tile]) {
+            for (int ty = py; ty < py + ph; ty++) {
+                rgb24_row_from_gray8(&g_draft.source[(size_t)ty * width + px],
+                                     fb_data + (size_t)ty * line_length + px * 3, pw);
+            }
+        }
+        g_draft.valid[tile] = 0;
+        removed++;
+    }
+    g_draft.count -= removed;
+}
+
+/**
+ * Prépare les caches du mode incrémental pour la géométrie du framebuffer
+ * (à appeler après prepare_frame_hashes, dont la grille de tuiles est partagée)
+ * @return 0 en cas de succès, -1 en cas d'erreur d'allocation
+ */
+static int prepare_frame_cache(int width, int height, int line_length) {
+    if (g_cache.source && g_cache.width == width && g_cache.height == height &&
+        g_cache.line_length == line_length) {
+        return 0;
+    }
+
+    release_frame_cache();
+    size_t pixels = (size_t)width * height;
+    size_t tiles = (size_t)g_frame.tiles_x * g_frame.tiles_y;
+    g_cache.source = malloc(pixels);
+    g_cache.filtered = malloc(pixels);
+    g_cache.source_hashes = malloc(sizeof(uint32_t) * tiles);
+    g_cache.incoming_hashes = malloc(sizeof(uint32_t) * tiles);
+    g_cache.source_valid = calloc(tiles, 1);
+    g_cache.state = malloc(tiles);
+    if (!g_cache.source || !g_cache.filtered || !g_cache.source_hashes ||
+        !g_cache.incoming_hashes || !g_cache.source_valid || !g_cache.state) {
+        release_frame_cache();
+        return -1;
+    }
+
+    g_cache.bytes = 2 * pixels + tiles * (2 * sizeof(uint32_t) + 2);
+    account_alloc(g_cache.bytes);
+    g_cache.width = width;
+    g_cache.height = height;
+    g_cache.line_length = line_length;
+    return 0;
+}
+
+/**
+ * Rectangle en pixels d'une tuile de la grille des empreintes
+ */
+static inline void frame_tile_rect(int tile, int *px, int *py, int *pw, int *ph) {
+    *px = (tile % g_frame.tiles_x) * FRAME_HASH_TILE;
+    *py = (tile / g_frame.tiles_x) * FRAME_HASH_TILE;
+    *pw = (*px + FRAME_HASH_TILE < g_frame.width) ? FRAME_HASH_TILE : g_frame.width - *px;
+    *ph = (*py + FRAME_HASH_TILE < g_frame.height) ? FRAME_HASH_TILE : g_frame.height - *py;
+}
+
+/**
+ * Invalide le cache source des tuiles touchées par un rectangle réécrit hors du
+ * mode incrémental (leur sortie ne correspond plus aux caches)
+ */
+static void invalidate_frame_cache(int x, int y, int w, int h) {
+    if (!g_cache.source) {
+        return;
+    }
+    for (int ty = y / FRAME_HASH_TILE; ty <= (y + h - 1) / FRAME_HASH_TILE; ty++) {
+        for (int tx = x / FRAME_HASH_TILE; tx <= (x + w - 1) / FRAME_HASH_TILE; tx++) {
+            g_cache.source_valid[ty * g_frame.tiles_x + tx] = 0;
+        }
+    }
+}
+
+/**
+ * Halo de contexte autour des tuiles refiltrées : quelques périodes de la fréquence de
+ * coupure (la réponse du passe-bas décroît en 1/distance au-delà), bornées pour garder
+ * des fenêtres FFT petites
+ */
+static int incremental_halo(float param_radius_max_diviser) {
+    int halo = (int)ceilf(INCREMENTAL_HALO_LOBES * param_radius_max_diviser);
+    halo = (halo < RECT_GUARD_MARGIN) ? RECT_GUARD_MARGIN : halo;
+    return (halo > INCREMENTAL_HALO_MAX) ? INCREMENTAL_HALO_MAX : halo;
+}
+
+/**
+ * Classe les tuiles de l'écran (TILE_CLEAN, TILE_RESTORE, TILE_DIRTY) d'après leurs empreintes
+ * @param dirty_count Nombre de tuiles à filtrer (sortie)
+ * @param restore_count Nombre de tuiles à reprendre du cache (sortie)
+ */
+static void classify_frame_tiles(const unsigned char *fb_data, int *dirty_count, int *restore_count) {
+    const int count = g_frame.tiles_x * g_frame.tiles_y;
+    int dirty = 0, restore = 0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:dirty, restore)
+    for (int tile = 0; tile < count; tile++) {
+        int px, py, pw, ph;
+        frame_tile_rect(tile, &px, &py, &pw, &ph);
+        uint32_t hash = hash_tile(fb_data, g_frame.line_length, px, py, pw, ph);
+        g_cache.incoming_hashes[tile] = hash;
+
+        if (g_frame.valid[tile] && hash == g_frame.hashes[tile]) {
+            g_cache.state[tile] = TILE_CLEAN;
+        } else if (g_cache.source_valid[tile] && hash == g_cache.source_hashes[tile]) {
+            g_cache.state[tile] = TILE_RESTORE;
+            restore++;
+        } else {
+            g_frame.valid[tile] = 0;
+            g_cache.state[tile] = TILE_DIRTY;
+            dirty++;
+        }
+    }
+
+    *dirty_count = dirty;
+    *restore_count = restore;
+}
+
+/**
+ * Met à jour le cache source avec la luminance des tuiles modifiées, en détectant la couleur
+ * Les tuiles propres dont le cache n'est plus cohérent (réécrites par un rectangle) prennent
+ * leur contenu actuel comme source, faute de mieux.
+ * @return 1 si une tuile modifiée contient de la couleur, 0 sinon
+ */
+static int load_dirty_tiles(const unsigned char *fb_data, int tolerance) {
+    const int count = g_frame.tiles_x * g_frame.tiles_y;
+    int found_colored = 0;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < count; tile++) {
+        int dirty = g_cache.state[tile] == TILE_DIRTY;
+        if (!dirty && (g_cache.state[tile] != TILE_CLEAN || g_cache.source_valid[tile])) {
+            continue;
+        }
+
+        int stop;
+        #pragma omp atomic read
+        stop = found_colored;
+        if (stop) {
+            continue;
+        }
+
+        int px, py, pw, ph;
+        float row[FRAME_HASH_TILE];
+        frame_tile_rect(tile, &px, &py, &pw, &ph);
+        for (int y = py; y < py + ph; y++) {
+            const unsigned char *src = fb_data + (size_t)y * g_frame.line_length + px * 3;
+            if (dirty && tolerance >= 0) {
+                if (luma_row_from_rgb24_detect(src, row, pw, tolerance)) {
+                    #pragma omp atomic write
+                    found_colored = 1;
+                    break;
+                }
+            } else {
+                luma_row_from_rgb24(src, row, pw);
+            }
+            gray8_row_from_luma(row, &g_cache.source[(size_t)y * g_cache.width + px], pw);
+        }
+    }
+
+    return found_colored;
+}
+
+/**
+ * Recopie la sortie en cache des tuiles dont la source n'a pas changé
+ */
+static void restore_frame_tiles(unsigned char *fb_data) {
+    const int count = g_frame.tiles_x * g_frame.tiles_y;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < count; tile++) {
+        if (g_cache.state[tile] != TILE_RESTORE) {
+            continue;
+        }
+
+        int px, py, pw, ph;
+        frame_tile_rect(tile, &px, &py, &pw, &ph);
+        for (int y = py; y < py + ph; y++) {
+            const unsigned char *src = &g_cache.filtered[(size_t)y * g_cache.width + px];
+            unsigned char *dst = fb_data + (size_t)y * g_frame.line_length + px * 3;
+            for (int x = 0; x < pw; x++) {
+                dst[x * 3] = dst[x * 3 + 1] = dst[x * 3 + 2] = src[x];
+            }
+        }
+        g_frame.hashes[tile] = hash_tile(fb_data, g_frame.line_length, px, py, pw, ph);
+        g_frame.valid[tile] = 1;
+    }
+}
+
+/**
+ * Filtre l'écran complet à partir du cache source (plus de la moitié des tuiles a changé)
+ * @return MOIRE_FILTERED ou -1 en cas d'erreur
+ */
+static int filter_frame_from_cache(unsigned char *fb_data, int width, int height, int line_length,
+                                   float param_radius_min, float param_radius_max_diviser) {
+    luma_io io = { g_cache.source, NULL, g_cache.filtered, width };
+    if (filter_screen(fb_data, width, height, line_length,
+                      param_radius_min, param_radius_max_diviser, -1, &io) != 0) {
+        return -1;
+    }
+
+    record_frame(fb_data, width, height, line_length);
+    return MOIRE_FILTERED;
+}
+
+/**
+ * Refiltre un rectangle de tuiles modifiées dans une fenêtre élargie du halo, lue depuis
+ * le cache source (les tuiles voisines du framebuffer sont déjà filtrées) : seul le
+ * rectangle est réécrit, comme dans un schéma overlap-save
+ * @return 0 en cas de succès, 1 si la fenêtre serait trop grande, -1 en cas d'erreur
+ */
+static int filter_dirty_rect(unsigned char *fb_data, int width, int height, int line_length,
+                             int x, int y, int w, int h, int halo,
+                             float param_radius_min, float param_radius_max_diviser) {
+    // Moteur spatial : le contexte est lu directement dans le cache source, et la zone
+    // réécrite est élargie du rayon du noyau (pixels dont la sortie dépend des tuiles
+    // modifiées), ce qui donne exactement le résultat d'un filtrage de tout l'écran
+    if (g_engine == MOIRE_ENGINE_SPATIAL && spatial_engine_applies(width, param_radius_min, param_radius_max_diviser)) {
+        int x0 = (x - SPATIAL_KERNEL_RADIUS < 0) ? 0 : x - SPATIAL_KERNEL_RADIUS;
+        int y0 = (y - SPATIAL_KERNEL_RADIUS < 0) ? 0 : y - SPATIAL_KERNEL_RADIUS;
+        int x1 = (x + w + SPATIAL_KERNEL_RADIUS > width) ? width : x + w + SPATIAL_KERNEL_RADIUS;
+        int y1 = (y + h + SPATIAL_KERNEL_RADIUS > height) ? height : y + h + SPATIAL_KERNEL_RADIUS;
+        luma_io io = { g_cache.source, NULL, g_cache.filtered, width };
+        if (filter_region_spatial(fb_data, width, height, line_length, x0, y0, x1 - x0, y1 - y0,
+                                  param_radius_max_diviser, -1, &io) != 0) {
+            return -1;
+        }
+        record_frame_tiles(fb_data, x0, y0, x1 - x0, y1 - y0);
+        return 0;
+    }
+
+    int win_w = rect_size_class(w + 2 * halo, width);
+    int win_h = rect_size_class(h + 2 * halo, height);
+    if ((float)win_w * win_h >= RECT_FULL_FRAME_RATIO * width * height) {
+        return 1;
+    }
+
+    // Moteur complet décimé : même réduction que pour l'écran complet, contexte lu dans le cache source
+    if (g_engine == MOIRE_ENGINE_FULL && g_decimation > 1) {
+        luma_io io = { g_cache.source, NULL, g_cache.filtered, width };
+        if (filter_region_decimated(fb_data, width, height, line_length, x, y, w, h, halo, g_decimation,
+                                    param_radius_min, param_radius_max_diviser, -1, &io) != 0) {
+            return -1;
+        }
+        record_frame_tiles(fb_data, x, y, w, h);
+        return 0;
+    }
+
+    int win_x = x + w / 2 - win_w / 2;
+    int win_y = y + h / 2 - win_h / 2;
+    win_x = (win_x < 0) ? 0 : ((win_x > width - win_w) ? width - win_w : win_x);
+    win_y = (win_y < 0) ? 0 : ((win_y > height - win_h) ? height - win_h : win_y);
+
+    fftw_resources *res = acquire_rect_resources(win_w, win_h, g_pad_mode);
+    if (!res) {
+        return -1;
+    }
+
+    size_t offset = (size_t)win_y * width + win_x;
+    luma_io io = { g_cache.source + offset, NULL, g_cache.filtered + offset, width };
+    if (filter_window(res, fb_data + win_y * line_length + win_x * 3, line_length,
+                      width, height, x - win_x, y - win_y, w, h,
+                      param_radius_min, param_radius_max_diviser, -1, NULL, &io) != 0) {
+        return -1;
+    }
+
+    record_frame_tiles(fb_data, x, y, w, h);
+    return 0;
+}
+
+/**
+ * Filtrage incrémental de l'écran complet
+ *
+ * Chaque tuile est comparée à la dernière sortie (rien à faire) puis à la dernière
+ * source (la sortie est reprise du cache). Les tuiles restantes sont regroupées en
+ * rectangles (suites de tuiles d'une ligne, fusionnées avec la ligne suivante si elles
+ * ont la même étendue) et refiltrées dans de petites fenêtres FFT. Au-delà de la moitié
+ * de l'écran, tout est refiltré à partir du cache source.
+ *
+ * @return MOIRE_FILTERED, MOIRE_COLORED, MOIRE_UNCHANGED ou -1 en cas d'erreur
+ */
+static int filter_frame_incremental(unsigned char *fb_data, int width, int height, int line_length,
+                                    int tolerance, float param_radius_min, float param_radius_max_diviser) {
+    const int tiles_x = g_frame.tiles_x, tiles_y = g_frame.tiles_y;
+    int dirty, restore;
+
+    classify_frame_tiles(fb_data, &dirty, &restore);
+    if (dirty == 0 && restore == 0) {
+        return MOIRE_UNCHANGED;
+    }
+
+    // Sources des tuiles modifiées, avec détection de couleur
+    if (dirty > 0 && load_dirty_tiles(fb_data, tolerance)) {
+        for (int tile = 0; tile < tiles_x * tiles_y; tile++) {
+            if (g_cache.state[tile] == TILE_DIRTY) {
+                g_cache.source_valid[tile] = 0;
+            }
+        }
+        return MOIRE_COLORED;
+    }
+
+    int rc = 1;
+    if (2 * dirty <= tiles_x * tiles_y) {
+        restore_frame_tiles(fb_data);
+        rc = 0;
+
+        int halo = incremental_halo(param_radius_max_diviser);
+
+        // Rectangles de tuiles modifiées : suites horizontales, prolongées vers le bas
+        // tant que la ligne suivante a exactement la même suite
+        for (int ty = 0; ty < tiles_y && rc == 0; ty++) {
+            int tx = 0;
+            while (tx < tiles_x && rc == 0) {
+                if (g_cache.state[ty * tiles_x + tx] != TILE_DIRTY) {
+                    tx++;
+                    continue;
+                }
+                int tx_end = tx;
+                while (tx_end < tiles_x && g_cache.state[ty * tiles_x + tx_end] == TILE_DIRTY) {
+                    tx_end++;
+                }
+                int ty_end = ty + 1;
+                while (ty_end < tiles_y) {
+                    int same = (tx == 0 || g_cache.state[ty_end * tiles_x + tx - 1] != TILE_DIRTY) &&
+                               (tx_end == tiles_x || g_cache.state[ty_end * tiles_x + tx_end] != TILE_DIRTY);
+                    for (int i = tx; i < tx_end && same; i++) {
+                        same = g_cache.state[ty_end * tiles_x + i] == TILE_DIRTY;
+                    }
+                    if (!same) {
+                        break;
+                    }
+                    // Les tuiles absorbées ne seront plus vues comme modifiées par les lignes suivantes
+                    for (int i = tx; i < tx_end; i++) {
+                        g_cache.state[ty_end * tiles_x + i] = TILE_CLEAN;
+                    }
+                    ty_end++;
+                }
+
+                int x = tx * FRAME_HASH_TILE, y = ty * FRAME_HASH_TILE;
+                int x_end = (tx_end * FRAME_HASH_TILE < width) ? tx_end * FRAME_HASH_TILE : width;
+                int y_end = (ty_end * FRAME_HASH_TILE < height) ? ty_end * FRAME_HASH_TILE : height;
+                rc = filter_dirty_rect(fb_data, width, height, line_length, x, y, x_end - x, y_end - y,
+                                       halo, param_radius_min, param_radius_max_diviser);
+                tx = tx_end;
+            }
+        }
+        if (rc < 0) {
+            return -1;
+        }
+    }
+
+    // Trop de tuiles modifiées (ou fenêtre trop grande) : tout refiltrer depuis le cache source
+    if (rc == 1 && filter_frame_from_cache(fb_data, width, height, line_length,
+                                           param_radius_min, param_radius_max_diviser) != 0) {
+        return -1;
+    }
+
+    // Les tuiles modifiées ont maintenant une source et une sortie cohérentes
+    for (int tile = 0; tile < tiles_x * tiles_y; tile++) {
+        if (g_cache.state[tile] == TILE_DIRTY || (rc == 0 && !g_cache.source_valid[tile] && g_frame.valid[tile] &&
+                                                  g_cache.incoming_hashes[tile] != g_frame.hashes[tile])) {
+            g_cache.source_hashes[tile] = g_cache.incoming_hashes[tile];
+            g_cache.source_valid[tile] = 1;
+        }
+    }
+    return MOIRE_FILTERED;
+}
+
+/**
+ * Libère une page du cache des pages
+ */
+static void release_page_entry(page_entry *entry) {
+    if (entry->gray) {
+        account_free(entry->bytes);
+        free(entry->gray);
+    }
+    g_pages.bytes -= entry->bytes;
+    memset(entry, 0, sizeof(*entry));
+}
+
+/**
+ * Libère les pages les moins récemment utilisées jusqu'à ce que needed octets tiennent dans le budget
+ */
+static void evict_pages(size_t needed) {
+    while (g_pages.bytes + needed > g_pages.budget) {
+        page_entry *victim = NULL;
+        for (int i = 0; i < PAGE_CACHE_MAX_ENTRIES; i++) {
+            page_entry *entry = &g_pages.entries[i];
+            if (entry->last_use && entry->bytes && (!victim || entry->last_use < victim->last_use)) {
+                victim = entry;
+            }
+        }
+        if (!victim) {
+            return;
+        }
+        release_page_entry(victim);
+    }
+}
+
+/**
+ * Libère toutes les pages du cache (le budget et les compteurs sont conservés)
+ */
+static void release_page_cache() {
+    for (int i = 0; i < PAGE_CACHE_MAX_ENTRIES; i++) {
+        release_page_entry(&g_pages.entries[i]);
+    }
+    g_pages.bytes = 0;
+    g_pages.clock = 0;
+}
+
+/**
+ * Remplit la clé d'une page avec les réglages courants
+ */
+static void page_key(page_entry *key, uint64_t source_hash, int width, int height, int tolerance,
+                     float param_radius_min, float param_radius_max_diviser) {
+    memset(key, 0, sizeof(*key));
+    key->source_hash = source_hash;
+    key->width = width;
+    key->height = height;
+    key->tolerance = tolerance;
+    key->radius_min = param_radius_min;
+    key->radius_max_diviser = param_radius_max_diviser;
+    key->engine = g_engine;
+    key->tile_size = g_tile_fft_size;
+    key->decimation = g_decimation;
+    key->pad_mode = g_pad_mode;
+}
+
+/**
+ * Cherche une page de même clé dans le cache
+ * @return L'entrée trouvée, NULL sinon
+ */
+static page_entry *find_page(const page_entry *key) {
+    for (int i = 0; i < PAGE_CACHE_MAX_ENTRIES; i++) {
+        page_entry *entry = &g_pages.entries[i];
+        if (entry->last_use && entry->source_hash == key->source_hash &&
+            entry->width == key->width && entry->height == key->height &&
+            entry->tolerance == key->tolerance && entry->radius_min == key->radius_min &&
+            entry->radius_max_diviser == key->radius_max_diviser && entry->engine == key->engine &&
+            entry->tile_size == key->tile_size && entry->decimation == key->decimation &&
+            entry->pad_mode == key->pad_mode) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Conserve le résultat d'un filtrage de l'écran complet (sortie en niveaux de gris 8 bits)
+ * Sans place dans le budget, la page n'est simplement pas conservée.
+ */
+static void store_page(const page_entry *key, const unsigned char *fb_data, int line_length, int result) {
+    size_t bytes = (result == MOIRE_FILTERED) ? (size_t)key->width * key->height : 0;
+    if (bytes > g_pages.budget) {
+        return;
+    }
+    evict_pages(bytes);
+
+    // Entrée libre, sinon la moins récemment utilisée
+    page_entry *slot = &g_pages.entries[0];
+    for (int i = 0; i < PAGE_CACHE_MAX_ENTRIES; i++) {
+        page_entry *entry = &g_pages.entries[i];
+        if (!entry->last_use) {
+            slot = entry;
+            break;
+        }
+        if (entry->last_use < slot->last_use) {
+            slot = entry;
+        }
+    }
+    release_page_entry(slot);
+
+    unsigned char *gray = NULL;
+    if (bytes) {
+        gray = malloc(bytes);
+        if (!gray) {
+            return;
+        }
+        account_alloc(bytes);
+
+        #pragma omp parallel for
+        for (int y = 0; y < key->height; y++) {
+            gray8_row_from_rgb24(&fb_data[(size_t)y * line_length], &gray[(size_t)y * key->width], key->width);
+        }
+    }
+
+    *slot = *key;
+    slot->result = result;
+    slot->gray = gray;
+    slot->bytes = bytes;
+    slot->last_use = ++g_pages.clock;
+    g_pages.bytes += bytes;
+}
+
+/**
+ * Écrit une page conservée dans le framebuffer et l'enregistre comme dernière image produite
+ */
+static void restore_page(page_entry *entry, unsigned char *fb_data, int line_length) {
+    #pragma omp parallel for
+    for (int y = 0; y < entry->height; y++) {
+        rgb24_row_from_gray8(&entry->gray[(size_t)y * entry->width], &fb_data[(size_t)y * line_length],
+                             entry->width);
+    }
+    record_frame(fb_data, entry->width, entry->height, line_length);
+}
+
+/**
+ * Énergie des fréquences supprimées par le filtre sur une tuile de PROBE_TILE_SIZE pixels
+ *
+ * La luminance centrée est pondérée par une fenêtre de Hann, puis transformée par une
+ * DFT séparable directe (la tuile est trop petite pour justifier un plan FFTW). Seules
+ * les fréquences au-delà du rayon maximal sont comptées, avec une marge de
+ * PROBE_GUARD_BINS cases pour ne pas compter les fuites de la fenêtre depuis les
+ * fréquences conservées ; l'atténuation partielle de la couronne (param_radius_min)
+ * est ignorée.
+ * @param window Fenêtre de Hann (PROBE_TILE_SIZE valeurs)
+ * @param cosines Table de cos(2πk/PROBE_TILE_SIZE)
+ * @param sines Table de sin(2πk/PROBE_TILE_SIZE)
+ * @param scale_x Passage des fréquences de la tuile à celles de l'écran (horizontal)
+ * @param scale_y Idem (vertical)
+ * @param radius_max Rayon maximal du filtre, en fréquences de l'écran
+ * @return Somme des carrés des modules des fréquences supprimées
+ */
+static double probe_tile_energy(const unsigned char *fb_data, int line_length, int x0, int y0,
+                                const float *window, const float *cosines, const float *sines,
+                                float scale_x, float scale_y, float radius_max) {
+    const int size = PROBE_TILE_SIZE;
+    const int half = PROBE_TILE_SIZE / 2 + 1;
+    float tile[PROBE_TILE_SIZE][PROBE_TILE_SIZE];
+    float row_re[PROBE_TILE_SIZE][PROBE_TILE_SIZE / 2 + 1];
+    float row_im[PROBE_TILE_SIZE][PROBE_TILE_SIZE / 2 + 1];
+    float mean = 0.0f;
+
+    for (int y = 0; y < size; y++) {
+        luma_row_from_rgb24(&fb_data[(y0 + y) * line_length + x0 * 3], tile[y], size);
+        for (int x = 0; x < size; x++) {
+            mean += tile[y][x];
+        }
+    }
+    mean /= size * size;
+
+    // DFT des lignes (moitié hermitienne)
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            tile[y][x] = (tile[y][x] - mean) * window[x] * window[y];
+        }
+        for (int kx = 0; kx < half; kx++) {
+            float re = 0.0f, im = 0.0f;
+            for (int x = 0; x < size; x++) {
+                int k = (kx * x) % size;
+                re += tile[y][x] * cosines[k];
+                im -= tile[y][x] * sines[k];
+            }
+            row_re[y][kx] = re;
+            row_im[y][kx] = im;
+        }
+    }
+
+    // DFT des colonnes, limitée aux fréquences hors du disque conservé (en cases de la
+    // tuile, la marge y étant ajoutée)
+    double energy = 0.0;
+    for (int ky = 0; ky < size; ky++) {
+        int fy = (ky + size / 2) % size - size / 2;
+        float dy = fy * scale_y;
+        for (int kx = 0; kx < half; kx++) {
+            float dx = kx * scale_x;
+            float radius = sqrtf(dx * dx + dy * dy);
+            if (radius <= radius_max + PROBE_GUARD_BINS * scale_x) {
+                continue;
+            }
+            float re = 0.0f, im = 0.0f;
+            for (int y = 0; y < size; y++) {
+                int k = (ky * y) % size;
+                re += row_re[y][kx] * cosines[k] + row_im[y][kx] * sines[k];
+                im += row_im[y][kx] * cosines[k] - row_re[y][kx] * sines[k];
+            }
+            // Les colonnes intérieures comptent aussi pour leur symétrique hermitienne
+            double weight = (kx == 0 || kx == size / 2) ? 1.0 : 2.0;
+            energy += weight * ((double)re * re + (double)im * im);
+        }
+    }
+    return energy;
+}
+
+/**
+ * Sonde l'écran : énergie de la luminance aux fréquences que le filtre supprime, mesurée
+ * sur PROBE_GRID² tuiles réparties sur l'écran. Le score est l'amplitude efficace (en
+ * niveaux de gris) de la composante supprimée dans la tuile la plus touchée : une page
+ * de texte simple ou de dessin au trait sur fond blanc a un score faible, une image
+ * tramée un score élevé.
+ * @return Score (niveaux de gris), -1 si l'écran est trop petit pour être sondé
+ */
+static double probe_frame_energy(const unsigned char *fb_data, int width, int height, int line_length,
+                                 float param_radius_max_diviser) {
+    const int size = PROBE_TILE_SIZE;
+    if (width < size || height < size) {
+        return -1.0;
+    }
+
+    float window[PROBE_TILE_SIZE], cosines[PROBE_TILE_SIZE], sines[PROBE_TILE_SIZE];
+    float window_power = 0.0f;
+    for (int i = 0; i < size; i++) {
+        window[i] = 0.5f - 0.5f * cosf(2.0f * PI * (i + 0.5f) / size);
+        window_power += window[i] * window[i];
+        cosines[i] = cosf(2.0f * PI * i / size);
+        sines[i] = sinf(2.0f * PI * i / size);
+    }
+    window_power /= size;
+
+    // Même repère que le masque : fréquences de l'écran entier
+    const float scale_x = (float)width / size;
+    const float scale_y = (float)height / size;
+    const float radius_max = width / param_radius_max_diviser;
+
+    double peak = 0.0;
+    #pragma omp parallel for schedule(dynamic) reduction(max:peak)
+    for (int i = 0; i < PROBE_GRID * PROBE_GRID; i++) {
+        int x0 = (2 * (i % PROBE_GRID) + 1) * width / (2 * PROBE_GRID) - size / 2;
+        int y0 = (2 * (i / PROBE_GRID) + 1) * height / (2 * PROBE_GRID) - size / 2;
+        x0 = (x0 < 0) ? 0 : ((x0 > width - size) ? width - size : x0);
+        y0 = (y0 < 0) ? 0 : ((y0 > height - size) ? height - size : y0);
+        double energy = probe_tile_energy(fb_data, line_length, x0, y0, window, cosines, sines,
+                                          scale_x, scale_y, radius_max);
+        peak = (energy > peak) ? energy : peak;
+    }
+
+    // Parseval, corrigé de la puissance de la fenêtre sur les deux dimensions
+    return sqrt(peak / ((double)size * size * size * size * window_power * window_power));
+}
+
+/**
+ * Vérifie si l'écran contient un pixel coloré (lecture complète, arrêtée au premier trouvé)
+ * @return 1 si l'image contient de la couleur, 0 sinon, -1 en cas d'erreur
+ */
+static int frame_has_color(const unsigned char *fb_data, int width, int height, int line_length, int tolerance) {
+    const int threads = omp_get_max_threads();
+    float *rows = malloc(sizeof(float) * width * threads);
+    int found_colored = 0;
+    if (!rows) {
+        return -1;
+    }
+
+    #pragma omp parallel num_threads(threads)
+    {
+        float *row = rows + (size_t)omp_get_thread_num() * width;
+        int y0, y1;
+        thread_row_band(height, &y0, &y1);
+        for (int y = y0; y < y1; y++) {
+            int stop;
+            #pragma omp atomic read
+            stop = found_colored;
+            if (stop) {
+                break;
+            }
+            if (luma_row_from_rgb24_detect(&fb_data[y * line_length], row, width, tolerance)) {
+                #pragma omp atomic write
+                found_colored = 1;
+                break;
+            }
+        }
+    }
+
+    free(rows);
+    return found_colored;
+}
+
+/**
+ * Omission du filtrage de l'écran complet (set_moire_skip_threshold) : sous le seuil,
+ * l'image est laissée telle quelle et enregistrée comme dernière image produite. Une
+ * image en couleur (tolérance positive ou nulle) est signalée comme telle.
+ * Le cache du mode incrémental ne décrit plus l'écran : le filtrage suivant repart
+ * de l'écran entier.
+ * @return MOIRE_SKIPPED ou MOIRE_COLORED si l'écran est laissé intact, MOIRE_FILTERED
+ *         s'il faut le filtrer, -1 en cas d'erreur
+ */
+static int probe_frame(const unsigned char *fb_data, int width, int height, int line_length,
+                       int tolerance, float param_radius_max_diviser) {
+    g_probe_score = probe_frame_energy(fb_data, width, height, line_length, param_radius_max_diviser);
+    g_probe_skipped = 0;
+    if (g_probe_score < 0.0 || g_probe_score >= g_skip_threshold) {
+        return MOIRE_FILTERED;
+    }
+
+    if (tolerance >= 0) {
+        int colored = frame_has_color(fb_data, width, height, line_length, tolerance);
+        if (colored != 0) {
+            g_cache.gray_frame = 0;
+            return (colored < 0) ? -1 : MOIRE_COLORED;
+        }
+    }
+
+    g_probe_skipped = 1;
+    g_cache.gray_frame = 0;
+    record_frame(fb_data, width, height, line_length);
+    return MOIRE_SKIPPED;
+}
+
+/**
+ * Filtrage de l'écran complet, incrémental si le mode est activé et que la dernière
+ * image a été entièrement produite par le filtre
+ * @param tolerance Tolérance de détection de couleur (négative : pas de détection)
+ * @return MOIRE_FILTERED, MOIRE_COLORED, MOIRE_UNCHANGED ou -1 en cas d'erreur
+ */
+static int filter_frame_uncached(unsigned char *fb_data, int width, int height, int line_length,
+                                 int tolerance, float param_radius_min, float param_radius_max_diviser) {
+    int use_cache = g_incremental_mode &&
+                    prepare_frame_hashes(width, height, line_length) == 0 &&
+                    prepare_frame_cache(width, height, line_length) == 0;
+
+    // Page sans énergie aux fréquences du moiré (rafraîchissements redondants exclus)
+    if (g_skip_threshold > 0.0f && !frame_unchanged(fb_data, width, height, line_length)) {
+        int rc = probe_frame(fb_data, width, height, line_length, tolerance, param_radius_max_diviser);
+        if (rc != MOIRE_FILTERED) {
+            return rc;
+        }
+    }
+
+    if (use_cache && g_cache.gray_frame) {
+        return filter_frame_incremental(fb_data, width, height, line_length, tolerance,
+                                        param_radius_min, param_radius_max_diviser);
+    }
+
+    // Rafraîchissement redondant : l'image a déjà été traitée
+    if (frame_unchanged(fb_data, width, height, line_length)) {
+        return MOIRE_UNCHANGED;
+    }
+
+    // Empreintes de la source, avant qu'elle soit remplacée par la sortie
+    if (use_cache) {
+        #pragma omp parallel for schedule(dynamic)
+        for (int tile = 0; tile < g_frame.tiles_x * g_frame.tiles_y; tile++) {
+            int px, py, pw, ph;
+            frame_tile_rect(tile, &px, &py, &pw, &ph);
+            g_cache.source_hashes[tile] = hash_tile(fb_data, line_length, px, py, pw, ph);
+        }
+    }
+
+    luma_io io = { NULL, g_cache.source, g_cache.filtered, width };
+    int rc = filter_screen(fb_data, width, height, line_length,
+                           param_radius_min, param_radius_max_diviser, tolerance, use_cache ? &io : NULL);
+    if (rc < 0) {
+        fprintf(stderr, "Erreur d'allocation des buffers FFTW\n");
+        return -1;
+    }
+
+    if (use_cache) {
+        memset(g_cache.source_valid, rc == MOIRE_FILTERED, g_frame.tiles_x * g_frame.tiles_y);
+        g_cache.gray_frame = rc == MOIRE_FILTERED;
+    }
+    if (rc == MOIRE_FILTERED) {
+        record_frame(fb_data, width, height, line_length);
+    }
+    return rc;
+}
+
+/**
+ * Filtre l'écran complet en passant par le cache des pages : une page déjà filtrée avec
+ * les mêmes réglages est recopiée sans détection de couleur ni FFT
+ * @return MOIRE_FILTERED, MOIRE_COLORED, MOIRE_UNCHANGED ou -1 en cas d'erreur
+ */
+static int filter_frame(unsigned char *fb_data, int width, int height, int line_length,
+                        int tolerance, float param_radius_min, float param_radius_max_diviser) {
+    // Les brouillons sont refiltrés depuis leur source
+    restore_draft_sources(fb_data, width, height, line_length, 0, 0, width, height);
+
+    if (g_pages.budget == 0) {
+        return filter_frame_uncached(fb_data, width, height, line_length, tolerance,
+                                     param_radius_min, param_radius_max_diviser);
+    }
+
+    page_entry key;
+    page_key(&key, hash_frame(fb_data, line_length, width, height), width, height, tolerance,
+             param_radius_min, param_radius_max_diviser);
+    page_entry *entry = find_page(&key);
+    if (entry) {
+        g_pages.hits++;
+        entry->last_use = ++g_pages.clock;
+        // Le cache du mode incrémental décrit encore la page précédente : le filtrage
+        // suivant repart de l'écran entier
+        g_cache.gray_frame = 0;
+        if (entry->result == MOIRE_FILTERED) {
+            restore_page(entry, fb_data, line_length);
+        }
+        return entry->result;
+    }
+
+    int rc = filter_frame_uncached(fb_data, width, height, line_length, tolerance,
+                                   param_radius_min, param_radius_max_diviser);
+    // Un rafraîchissement redondant (sortie déjà à l'écran) n'est pas un défaut du cache
+    if (rc == MOIRE_FILTERED || rc == MOIRE_COLORED) {
+        g_pages.misses++;
+        store_page(&key, fb_data, line_length, rc);
+    }
+    return rc;
+}
+
+/**
+ * Fonction principale pour supprimer le moiré
+ *
+ * @param fb_data Données du framebuffer d'entrée (modifiées sur place)
+ * @param width Largeur de l'image
+ * @param height Hauteur de l'image
+ * @param line_length Longueur de ligne du framebuffer
+ * @param param_radius_min Rayon minimal pour le filtre passe-bas
+ * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
+ * @return MOIRE_FILTERED, MOIRE_UNCHANGED si l'image est déjà la dernière sortie
+ *         (refiltrer dégraderait l'image), -1 en cas d'erreur
+ */
+EXPORT int remove_moire(unsigned char *fb_data, int width, int height, int line_length,
+                 float param_radius_min, float param_radius_max_diviser) {
+    return filter_frame(fb_data, width, height, line_length, -1,
+                        param_radius_min, param_radius_max_diviser);
+}
+
+/**
+ * Supprime le moiré de l'écran complet s'il ne contient pas de couleur
+ *
+ * La détection de couleur et la conversion en luminance se font en une seule lecture
+ * du framebuffer, au lieu d'un appel à is_framebuffer_colored() suivi de remove_moire().
+ * Dès qu'un pixel coloré est trouvé, la conversion est abandonnée et le framebuffer
+ * n'est pas modifié.
+ *
+ * @param fb_data Données du framebuffer d'entrée (modifiées sur place)
+ * @param width Largeur de l'image
+ * @param height Hauteur de l'image
+ * @param line_length Longueur de ligne du framebuffer
+ * @param tolerance Écart entre canaux au-delà duquel un pixel est considéré coloré
+ * @param param_radius_min Rayon minimal pour le filtre passe-bas
+ * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
+ * @return MOIRE_FILTERED si le moiré a été supprimé, MOIRE_COLORED si l'image contient
+ *         de la couleur, MOIRE_UNCHANGED si l'image est la dernière sortie enregistrée
+ *         (filtrée ou ajustée en couleur, voir record_moire_frame), -1 en cas d'erreur
+ */
+EXPORT int remove_moire_if_gray(unsigned char *fb_data, int width, int height, int line_length,
+                                int tolerance, float param_radius_min, float param_radius_max_diviser) {
+    return filter_frame(fb_data, width, height, line_length, tolerance < 0 ? 0 : tolerance,
+                        param_radius_min, param_radius_max_diviser);
+}
+
+/**
+ * Supprime le moiré de l'écran complet sauf dans les tuiles marquées
+ *
+ * Destiné aux pages mixtes : la carte des tuiles colorées est produite par
+ * framebuffer_color_tiles() de color_detect. Toute l'image est transformée (les
+ * tuiles colorées servent de contexte au filtre), mais les pixels des tuiles
+ * marquées ne sont pas réécrits et gardent leurs couleurs.
+ *
+ * @param fb_data Données du framebuffer d'entrée (modifiées sur place)
+ * @param width Largeur de l'image
+ * @param height Hauteur de l'image
+ * @param line_length Longueur de ligne du framebuffer
+ * @param tiles Carte des tuiles, ligne par ligne, ceil(width / tile_size) par ligne (non nul : tuile intacte)
+ * @param tile_size Côté des tuiles en pixels
+ * @param param_radius_min Rayon minimal pour le filtre passe-bas
+ * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
+ * @return MOIRE_FILTERED en cas de succès, -1 en cas d'erreur
+ */
+EXPORT int remove_moire_masked(unsigned char *fb_data, int width, int height, int line_length,
+                               const unsigned char *tiles, int tile_size,
+                               float param_radius_min, float param_radius_max_diviser) {
+    if (!tiles || tile_size <= 0) {
+        return -1;
+    }
+
+    // Les brouillons sont refiltrés depuis leur source
+    restore_draft_sources(fb_data, width, height, line_length, 0, 0, width, height);
+
+    // Initialiser ou réutiliser les ressources FFTW
+    if (init_fftw_resources(width, height, line_length, g_pad_mode) != 0) {
+        fprintf(stderr, "Erreur d'initialisation des ressources FFTW\n");
+        return -1;
+    }
+
+    output_mask mask = { tiles, tile_size, (width + tile_size - 1) / tile_size };
+    if (filter_window(&g_screen->full, fb_data, line_length, width, height, 0, 0, width, height,
+                      param_radius_min, param_radius_max_diviser, -1, &mask, NULL) != 0) {
+        fprintf(stderr, "Erreur d'allocation des buffers FFTW\n");
+        return -1;
+    }
+
+    // Les tuiles colorées seront encore modifiées par l'appelant : il doit ensuite
+    // appeler record_moire_frame() pour enregistrer l'image finale
+    record_frame(fb_data, width, height, line_length);
+    g_cache.gray_frame = 0;
+    return MOIRE_FILTERED;
+}
+
+/**
+ * Filtre un rectangle (déjà limité à l'écran) avec le moteur spatial, sans fenêtre FFT :
+ * le contexte est lu autour du rectangle et seul le rectangle est réécrit
+ * @return MOIRE_FILTERED, MOIRE_UNCHANGED ou -1 en cas d'erreur
+ */
+static int filter_rect_spatial(unsigned char *fb_data, int width, int height, int line_length,
+                               int x, int y, int w, int h, float param_radius_max_diviser) {
+    if (prepare_frame_hashes(width, height, line_length) == 0 &&
+        frame_rect_unchanged(fb_data, x, y, w, h)) {
+        return MOIRE_UNCHANGED;
+    }
+
+    if (filter_region_spatial(fb_data, width, height, line_length, x, y, w, h,
+                              param_radius_max_diviser, -1, NULL) != 0) {
+        fprintf(stderr, "Erreur d'allocation du moteur spatial\n");
+        return -1;
+    }
+
+    if (g_frame.hashes) {
+        record_frame_tiles(fb_data, x, y, w, h);
+    }
+    invalidate_frame_cache(x, y, w, h);
+    return MOIRE_FILTERED;
+}
+
+/**
+ * Supprime le moiré uniquement dans un rectangle du framebuffer (rafraîchissements partiels)
+ *
+ * Le rectangle est élargi d'une marge de garde puis arrondi à une classe de taille,
+ * dont les plans sont conservés. Seul le rectangle demandé est réécrit : la marge sert
+ * de contexte pour limiter les artefacts de bord de la FFT. Un rectangle couvrant une
+ * grande partie de l'écran est traité comme un rafraîchissement complet.
+ *
+ * @param fb_data Données du framebuffer (modifiées sur place)
+ * @param width Largeur de l'écran
+ * @param height Hauteur de l'écran
+ * @param line_length Longueur de ligne du framebuffer
+ * @param x, y, w, h Rectangle à rafraîchir (coordonnées physiques)
+ * @param param_radius_min Rayon minimal pour le filtre passe-bas
+ * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
+ * @return MOIRE_FILTERED, MOIRE_UNCHANGED si le rectangle est déjà la dernière sortie,
+ *         -1 en cas d'erreur
+ */
+EXPORT int remove_moire_rect(unsigned char *fb_data, int width, int height, int line_length,
+                             int x, int y, int w, int h,
+                             float param_radius_min, float param_radius_max_diviser) {
+    // Limiter le rectangle à l'écran
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > width) w = width - x;
+    if (y + h > height) h = height - y;
+    if (w <= 0 || h <= 0) {
+        return MOIRE_FILTERED;
+    }
+
+    restore_draft_sources(fb_data, width, height, line_length, x, y, w, h);
+
+    if (g_engine == MOIRE_ENGINE_SPATIAL && spatial_engine_applies(width, param_radius_min, param_radius_max_diviser)) {
+        return filter_rect_spatial(fb_data, width, height, line_length, x, y, w, h, param_radius_max_diviser);
+    }
+
+    int win_w = rect_size_class(w + 2 * RECT_GUARD_MARGIN, width);
+    int win_h = rect_size_class(h + 2 * RECT_GUARD_MARGIN, height);
+
+    if ((float)win_w * win_h >= RECT_FULL_FRAME_RATIO * width * height) {
+        return remove_moire(fb_data, width, height, line_length, param_radius_min, param_radius_max_diviser);
+    }
+
+    // Rafraîchissement redondant : le rectangle a déjà été filtré. Toutes les tuiles
+    // touchées sont vérifiées pour que l'enregistrement suivant sache lesquelles ont changé.
+    if (prepare_frame_hashes(width, height, line_length) == 0 &&
+        frame_rect_unchanged(fb_data, x, y, w, h)) {
+        return MOIRE_UNCHANGED;
+    }
+
+    // Centrer la fenêtre sur le rectangle sans sortir de l'écran
+    int win_x = x + w / 2 - win_w / 2;
+    int win_y = y + h / 2 - win_h / 2;
+    win_x = (win_x < 0) ? 0 : ((win_x > width - win_w) ? width - win_w : win_x);
+    win_y = (win_y < 0) ? 0 : ((win_y > height - win_h) ? height - win_h : win_y);
+
+    fftw_resources *res = acquire_rect_resources(win_w, win_h, g_pad_mode);
+    if (!res) {
+        fprintf(stderr, "Erreur d'initialisation des ressources FFTW (rectangle %dx%d)\n", win_w, win_h);
+        return -1;
+    }
+
+    if (filter_window(res, fb_data + win_y * line_length + win_x * 3, line_length,
+                      width, height, x - win_x, y - win_y, w, h,
+                      param_radius_min, param_radius_max_diviser, -1, NULL, NULL) != 0) {
+        return -1;
+    }
+
+    if (g_frame.hashes) {
+        record_frame_tiles(fb_data, x, y, w, h);
+    }
+    invalidate_frame_cache(x, y, w, h);
+    return MOIRE_FILTERED;
+}
+
+/**
+ * Supprime le moiré d'un rectangle avec un niveau de qualité donné
+ *
+ * MOIRE_QUALITY_FULL équivaut à remove_moire_rect(). MOIRE_QUALITY_REDUCED filtre à
+ * résolution réduite (rafraîchissements rapides : défilement, zoom) et garde la source
+ * des tuiles touchées : le filtrage pleine qualité suivant de ces tuiles (rafraîchissement
+ * complet ou partiel) repart de la source. MOIRE_QUALITY_BYPASS ne modifie rien, le
+ * rectangle sera filtré au rafraîchissement suivant.
+ *
+ * @param quality MOIRE_QUALITY_FULL, MOIRE_QUALITY_REDUCED ou MOIRE_QUALITY_BYPASS
+ * @return MOIRE_FILTERED, MOIRE_UNCHANGED si le rectangle est déjà la dernière sortie,
+ *         MOIRE_SKIPPED (niveau MOIRE_QUALITY_BYPASS), -1 en cas d'erreur
+ */
+EXPORT int remove_moire_rect_quality(unsigned char *fb_data, int width, int height, int line_length,
+                                     int x, int y, int w, int h, int quality,
+                                     float param_radius_min, float param_radius_max_diviser) {
+    if (quality == MOIRE_QUALITY_BYPASS) {
+        return MOIRE_SKIPPED;
+    }
+    if (quality != MOIRE_QUALITY_REDUCED) {
+        return remove_moire_rect(fb_data, width, height, line_length, x, y, w, h,
+                                 param_radius_min, param_radius_max_diviser);
+    }
+
+    // Limiter le rectangle à l'écran
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > width) w = width - x;
+    if (y + h > height) h = height - y;
+    if (w <= 0 || h <= 0) {
+        return MOIRE_FILTERED;
+    }
+
+    // Rafraîchissement redondant : sortie pleine qualité ou brouillon déjà à l'écran
+    if (prepare_frame_hashes(width, height, line_length) == 0 &&
+        frame_rect_unchanged(fb_data, x, y, w, h)) {
+        return MOIRE_UNCHANGED;
+    }
+    if (prepare_draft_frame(width, height, line_length) != 0) {
+        return -1;
+    }
+    if (draft_rect_unchanged(fb_data, x, y, w, h)) {
+        return MOIRE_UNCHANGED;
+    }
+
+    save_draft_sources(fb_data, x, y, w, h);
+    if (filter_region_decimated(fb_data, width, height, line_length, x, y, w, h,
+                                RECT_GUARD_MARGIN, REDUCED_FACTOR,
+                                param_radius_min, param_radius_max_diviser, -1, NULL) != 0) {
+        return -1;
+    }
+    record_draft_tiles(fb_data, x, y, w, h);
+    invalidate_frame_cache(x, y, w, h);
+    return MOIRE_FILTERED;
+}
+
+/**
+ * Supprime le moiré de l'écran complet avec le moteur spatial (convolution séparable,
+ * sans FFT ni plans), quel que soit le moteur sélectionné
+ * Hors de la configuration passe-bas pur, équivaut à remove_moire().
+ *
+ * @param fb_data Données du framebuffer d'entrée (modifiées sur place)
+ * @param width Largeur de l'image
+ * @param height Hauteur de l'image
+ * @param line_length Longueur de ligne du framebuffer
+ * @param param_radius_min Rayon minimal pour le filtre passe-bas
+ * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
+ * @return MOIRE_FILTERED, MOIRE_UNCHANGED si l'image est déjà la dernière sortie, -1 en cas d'erreur
+ */
+EXPORT int remove_moire_spatial(unsigned char *fb_data, int width, int height, int line_length,
+                                float param_radius_min, float param_radius_max_diviser) {
+    if (!spatial_engine_applies(width, param_radius_min, param_radius_max_diviser)) {
+        return remove_moire(fb_data, width, height, line_length, param_radius_min, param_radius_max_diviser);
+    }
+
+    if (frame_unchanged(fb_data, width, height, line_length)) {
+        return MOIRE_UNCHANGED;
+    }
+
+    if (filter_region_spatial(fb_data, width, height, line_length, 0, 0, width, height,
+                              param_radius_max_diviser, -1, NULL) != 0) {
+        fprintf(stderr, "Erreur d'allocation du moteur spatial\n");
+        return -1;
+    }
+
+    record_frame(fb_data, width, height, line_length);
+    // Les caches du mode incrémental n'ont pas suivi : prochain filtrage complet
+    g_cache.gray_frame = 0;
+    return MOIRE_FILTERED;
+}
+
+/**
+ * Supprime le moiré d'un rectangle avec le moteur spatial, quel que soit le moteur
+ * sélectionné ; hors de la configuration passe-bas pur, équivaut à remove_moire_rect()
+ * @param x, y, w, h Rectangle à filtrer (coordonnées écran)
+ * @return MOIRE_FILTERED, MOIRE_UNCHANGED si le rectangle est déjà la dernière sortie,
+ *         -1 en cas d'erreur
+ */
+EXPORT int remove_moire_spatial_rect(unsigned char *fb_data, int width, int height, int line_length,
+                                     int x, int y, int w, int h,
+                                     float param_radius_min, float param_radius_max_diviser) {
+    if (!spatial_engine_applies(width, param_radius_min, param_radius_max_diviser)) {
+        return remove_moire_rect(fb_data, width, height, line_length, x, y, w, h,
+                                 param_radius_min, param_radius_max_diviser);
+    }
+
+    // Limiter le rectangle à l'écran
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > width) w = width - x;
+    if (y + h > height) h = height - y;
+    if (w <= 0 || h <= 0) {
+        return MOIRE_FILTERED;
+    }
+
+    return filter_rect_spatial(fb_data, width, height, line_length, x, y, w, h, param_radius_max_diviser);
+}
+
+/**
+ * Vérifie si un rectangle du framebuffer est identique à la dernière image produite
+ * (filtrée ou enregistrée par record_moire_frame), pour éviter de relancer la détection
+ * de couleur et le filtrage lors d'un rafraîchissement redondant
+ * @param fb_data Données du framebuffer
+ * @param width Largeur de l'image
+ * @param height Hauteur de l'image
+ * @param line_length Longueur de ligne du framebuffer
+ * @param x, y, w, h Rectangle à vérifier (w ou h nul : écran complet)
+ * @return 1 si identique, 0 sinon
+ */
+EXPORT int is_moire_frame_unchanged(unsigned char *fb_data, int width, int height, int line_length,
+                                    int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0) {
+        x = 0; y = 0; w = width; h = height;
+    }
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > width) w = width - x;
+    if (y + h > height) h = height - y;
+    if (w <= 0 || h <= 0 || prepare_frame_hashes(width, height, line_length) != 0) {
+        return 0;
+    }
+    return frame_rect_unchanged(fb_data, x, y, w, h);
+}
+
+/**
+ * Enregistre l'écran complet comme dernière image produite, après un traitement fait
+ * hors de la bibliothèque (ajustement des couleurs) : un rafraîchissement suivant du
+ * même contenu sera reconnu comme redondant
+ * @param fb_data Données du framebuffer
+ * @param width Largeur de l'image
+ * @param height Hauteur de l'image
+ * @param line_length Longueur de ligne du framebuffer
+ */
+EXPORT void record_moire_frame(unsigned char *fb_data, int width, int height, int line_length) {
+    record_frame(fb_data, width, height, line_length);
+    // Image produite hors du filtre : le mode incrémental repartira d'un filtrage complet
+    g_cache.gray_frame = 0;
+}
+
+/**
+ * Active le mode incrémental pour l'écran complet : la dernière source et la dernière
+ * sortie sont conservées (2 octets par pixel) pour ne refiltrer que les tuiles modifiées
+ * et reprendre du cache celles dont la source n'a pas changé
+ * @param enabled 1 pour activer, 0 pour désactiver (les caches sont libérés)
+ */
+EXPORT void set_moire_incremental(int enabled) {
+    g_incremental_mode = enabled != 0;
+    if (!g_incremental_mode) {
+        release_frame_cache();
+    }
+}
+
+EXPORT int init_moire_resources() {
+    // Initialisation des threads FFTW une seule fois
+    ensure_fftw_threads();
+    return 0;
+}
+
+/**
+ * Charge la sagesse FFTW d'un fichier et retient son chemin pour les sauvegardes
+ * et pour la recharger après un cleanup_moire_resources()
+ * @param path Chemin du fichier de sagesse
+ * @return 0 si la sagesse a été chargée, -1 sinon (fichier absent ou invalide)
+ */
+EXPORT int load_moire_wisdom(const char *path) {
+    if (!path || strlen(path) >= sizeof(g_wisdom_path)) {
+        return -1;
+    }
+    strcpy(g_wisdom_path, path);
+
+    // Les solveurs multi-threads doivent être enregistrés avant l'import
+    ensure_fftw_threads();
+    g_wisdom_loaded = fftwf_import_wisdom_from_filename(g_wisdom_path);
+    return g_wisdom_loaded ? 0 : -1;
+}
+
+/**
+ * Sauvegarde la sagesse FFTW si de nouveaux plans ont été créés depuis la dernière
+ * sauvegarde. L'écriture passe par un fichier temporaire renommé ensuite, pour ne
+ * jamais laisser un fichier tronqué en cas de coupure.
+ * @return 1 si le fichier a été écrit, 0 s'il n'y avait rien à sauvegarder, -1 en cas d'erreur
+ */
+EXPORT int save_moire_wisdom() {
+    int rc = 0;
+
+    // Même section que la planification : le thread de fond peut ajouter des plans
+    // pendant l'export, et un plan créé avant la remise à zéro serait perdu
+    #pragma omp critical(moire_planner)
+    {
+        if (g_wisdom_path[0] && g_wisdom_dirty) {
+            char tmp_path[sizeof(g_wisdom_path) + 4];
+            snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", g_wisdom_path);
+            if (!fftwf_export_wisdom_to_filename(tmp_path) || rename(tmp_path, g_wisdom_path) != 0) {
+                remove(tmp_path);
+                rc = -1;
+            } else {
+                g_wisdom_dirty = 0;
+                rc = 1;
+            }
+        }
+    }
+    return rc;
+}
+
+/**
+ * Génère une sagesse FFTW_PATIENT pour une taille d'écran, avec et sans bourrage
+ * (hors ligne, par exemple depuis moire_wisdom_gen). Les plans ainsi mesurés sont retrouvés par les
+ * planifications FFTW_MEASURE suivantes. À compléter par save_moire_wisdom().
+ * @param width Largeur de l'écran
+ * @param height Hauteur de l'écran
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+EXPORT int generate_moire_wisdom(int width, int height) {
+    fftw_resources res;
+    memset(&res, 0, sizeof(res));
+
+    if (create_fftw_resources(&res, width, height, MOIRE_PAD_NONE, g_lean_mode,
+                              omp_get_max_threads(), FFTW_PATIENT) != 0) {
+        return -1;
+    }
+    release_fftw_resources(&res);
+
+    // Taille avec bourrage (identique pour tous les modes de bourrage)
+    if (fft_friendly_size(width) != width || fft_friendly_size(height) != height) {
+        if (create_fftw_resources(&res, width, height, MOIRE_PAD_MIRROR, g_lean_mode,
+                                  omp_get_max_threads(), FFTW_PATIENT) != 0) {
+            return -1;
+        }
+        release_fftw_resources(&res);
+    }
+    return 0;
+}
+
+/**
+ * Active le mode économe en mémoire : un seul buffer de height * 2 * (width/2 + 1)
+ * floats par taille de transformée, FFT et IFFT sur place, soit moins de la moitié
+ * de la mémoire du mode normal.
+ * (appliqué aux prochains filtrages, les plans sont recréés)
+ * @param enabled 1 pour activer, 0 pour revenir aux buffers séparés
+ */
+EXPORT void set_moire_lean_mode(int enabled) {
+    g_lean_mode = enabled ? 1 : 0;
+}
+
+/**
+ * Choisit le moteur de filtrage de l'écran complet. Le moteur par tuiles n'a en mémoire
+ * qu'une rangée de tuiles (environ 2 x tile_size lignes de l'écran) et un buffer de
+ * tuile par thread, qui tient dans le cache du processeur ; les rafraîchissements
+ * partiels utilisent toujours leurs propres fenêtres. Le moteur spatial (passe-bas pur
+ * uniquement) remplace aussi les fenêtres des rafraîchissements partiels.
+ * @param engine MOIRE_ENGINE_FULL, MOIRE_ENGINE_TILED ou MOIRE_ENGINE_SPATIAL
+ * @param tile_size Côté des tuiles du moteur par tuiles (puissance de 2 de 64 à 512)
+ * @return 0 en cas de succès, -1 si le moteur ou la taille sont invalides
+ */
+EXPORT int set_moire_engine(int engine, int tile_size) {
+    if (engine < MOIRE_ENGINE_FULL || engine > MOIRE_ENGINE_SPATIAL ||
+        tile_size < TILED_MIN_SIZE || tile_size > TILED_MAX_SIZE || (tile_size & (tile_size - 1)) != 0) {
+        return -1;
+    }
+
+    if (tile_size != g_tile_fft_size) {
+        release_tiled_engine();
+        g_tile_fft_size = tile_size;
+    }
+    // Libérer le moteur abandonné (le moteur spatial n'a pas de ressources persistantes)
+    if (engine != MOIRE_ENGINE_FULL && g_engine == MOIRE_ENGINE_FULL) {
+        release_screen_contexts();
+    }
+    if (engine != MOIRE_ENGINE_TILED) {
+        release_tiled_engine();
+    }
+    g_engine = engine;
+    return 0;
+}
+
+/**
+ * Décimation du moteur complet : l'écran est filtré à une résolution réduite d'un
+ * facteur entier (factor² fois moins de points de FFT et de mémoire), puis interpolé.
+ * Plus rapide mais plus doux ; s'applique aussi aux tuiles du mode incrémental.
+ * Les moteurs par tuiles et spatial ne sont pas concernés.
+ * @param factor 1 (pleine résolution) à MOIRE_DECIMATION_MAX
+ * @return 0 en cas de succès, -1 si le facteur est invalide
+ */
+EXPORT int set_moire_decimation(int factor) {
+    if (factor < 1 || factor > MOIRE_DECIMATION_MAX) {
+        return -1;
+    }
+
+    // Les plans de l'écran réduit sont pris parmi ceux des rectangles
+    if (factor > 1) {
+        release_screen_contexts();
+    }
+    // Les sorties du cache du mode incrémental ont été produites à l'ancienne résolution
+    if (factor != g_decimation) {
+        g_cache.gray_frame = 0;
+    }
+    g_decimation = factor;
+    return 0;
+}
+
+/**
+ * PSNR (dB) entre deux images grises RGB24, sur la luminance (un canal par pixel)
+ */
+static double luma_psnr(const unsigned char *a, const unsigned char *b, int width, int height, int line_length) {
+    double error = 0.0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            double diff = (double)a[y * line_length + x * 3] - b[y * line_length + x * 3];
+            error += diff * diff;
+        }
+    }
+    error /= (double)width * height;
+    return (error > 0.0) ? 10.0 * log10(255.0 * 255.0 / error) : 99.0;
+}
+
+/**
+ * SSIM moyen entre deux images grises RGB24, sur des blocs de 8 x 8 pixels
+ * (constantes usuelles C1 = (0.01 * 255)², C2 = (0.03 * 255)²)
+ */
+static double luma_ssim(const unsigned char *a, const unsigned char *b, int width, int height, int line_length) {
+    const double c1 = 6.5025, c2 = 58.5225;
+    double total = 0.0;
+    int blocks = 0;
+
+    for (int by = 0; by + 8 <= height; by += 8) {
+        for (int bx = 0; bx + 8 <= width; bx += 8) {
+            double sa = 0.0, sb = 0.0, saa = 0.0, sbb = 0.0, sab = 0.0;
+            for (int y = by; y < by + 8; y++) {
+                for (int x = bx; x < bx + 8; x++) {
+                    double va = a[y * line_length + x * 3];
+                    double vb = b[y * line_length + x * 3];
+                    sa += va; sb += vb;
+                    saa += va * va; sbb += vb * vb; sab += va * vb;
+                }
+            }
+            double ma = sa / 64.0, mb = sb / 64.0;
+            double va = saa / 64.0 - ma * ma, vb = sbb / 64.0 - mb * mb, cov = sab / 64.0 - ma * mb;
+            total += ((2.0 * ma * mb + c1) * (2.0 * cov + c2)) /
+                     ((ma * ma + mb * mb + c1) * (va + vb + c2));
+            blocks++;
+        }
+    }
+    return blocks ? total / blocks : 1.0;
+}
+
+/**
+ * Libère les ressources des moteurs non sélectionnés après une comparaison
+ */
+static void release_unselected_engines() {
+    if (g_engine != MOIRE_ENGINE_FULL || g_decimation > 1) {
+        release_screen_contexts();
+    }
+    if (g_engine != MOIRE_ENGINE_TILED) {
+        release_tiled_engine();
+    }
+}
+
+/**
+ * Compare les deux moteurs sur une copie de l'image (le framebuffer n'est pas modifié)
+ * Les ressources du moteur non sélectionné sont libérées à la fin.
+ * @param results Sortie : durées des moteur complet et par tuiles (ms), puis leur
+ *        mémoire de travail (octets, masques compris), soit 4 valeurs
+ * @return PSNR (dB) de la sortie par tuiles par rapport au moteur complet,
+ *         -1 en cas d'erreur
+ */
+EXPORT double compare_moire_engines(const unsigned char *fb_data, int width, int height, int line_length,
+                                    float param_radius_min, float param_radius_max_diviser,
+                                    double *results) {
+    size_t size = (size_t)line_length * height;
+    unsigned char *full = malloc(size);
+    unsigned char *tiled = malloc(size);
+    double psnr = -1.0;
+
+    if (!full || !tiled) {
+        free(full);
+        free(tiled);
+        return -1.0;
+    }
+    memcpy(full, fb_data, size);
+    memcpy(tiled, fb_data, size);
+
+    // Premier passage hors mesure : plans et masques
+    if (init_fftw_resources(width, height, line_length, g_pad_mode) == 0 &&
+        filter_window(&g_screen->full, full, line_length, width, height, 0, 0, width, height,
+                      param_radius_min, param_radius_max_diviser, -1, NULL, NULL) == 0 &&
+        filter_frame_tiled(tiled, width, height, line_length,
+                           param_radius_min, param_radius_max_diviser, -1, NULL) == 0) {
+        memcpy(full, fb_data, size);
+        memcpy(tiled, fb_data, size);
+
+        double start = omp_get_wtime();
+        filter_window(&g_screen->full, full, line_length, width, height, 0, 0, width, height,
+                      param_radius_min, param_radius_max_diviser, -1, NULL, NULL);
+        results[0] = (omp_get_wtime() - start) * 1000.0;
+
+        start = omp_get_wtime();
+        filter_frame_tiled(tiled, width, height, line_length,
+                           param_radius_min, param_radius_max_diviser, -1, NULL);
+        results[1] = (omp_get_wtime() - start) * 1000.0;
+
+        results[2] = (double)(g_screen->full.bytes + g_screen->full.mask.bytes);
+        results[3] = (double)(g_tiled.bytes + g_tiled.plans.bytes + g_tiled.plans.mask.bytes);
+
+        psnr = luma_psnr(full, tiled, width, height, line_length);
+    }
+
+    release_unselected_engines();
+    free(full);
+    free(tiled);
+    return psnr;
+}
+
+/**
+ * Compare le moteur spatial au moteur complet (FFT) sur une copie de l'image
+ * (le framebuffer n'est pas modifié ; les ressources du moteur non sélectionné sont libérées)
+ * @param results Sortie : durées du moteur complet et du moteur spatial (ms), puis SSIM
+ *        de la sortie spatiale par rapport au moteur complet, soit 3 valeurs
+ * @return PSNR (dB) de la sortie spatiale par rapport au moteur complet, -1 en cas
+ *         d'erreur ou hors de la configuration passe-bas pur
+ */
+EXPORT double compare_moire_spatial(const unsigned char *fb_data, int width, int height, int line_length,
+                                    float param_radius_min, float param_radius_max_diviser,
+                                    double *results) {
+    size_t size = (size_t)line_length * height;
+    unsigned char *full;
+    unsigned char *spatial;
+    double psnr = -1.0;
+
+    if (!spatial_engine_applies(width, param_radius_min, param_radius_max_diviser)) {
+        return -1.0;
+    }
+
+    full = malloc(size);
+    spatial = malloc(size);
+    if (!full || !spatial) {
+        free(full);
+        free(spatial);
+        return -1.0;
+    }
+    memcpy(full, fb_data, size);
+    memcpy(spatial, fb_data, size);
+
+    // Premier passage hors mesure pour le moteur complet : plans
+    if (init_fftw_resources(width, height, line_length, g_pad_mode) == 0 &&
+        filter_window(&g_screen->full, full, line_length, width, height, 0, 0, width, height,
+                      param_radius_min, param_radius_max_diviser, -1, NULL, NULL) == 0) {
+        memcpy(full, fb_data, size);
+
+        double start = omp_get_wtime();
+        filter_window(&g_screen->full, full, line_length, width, height, 0, 0, width, height,
+                      param_radius_min, param_radius_max_diviser, -1, NULL, NULL);
+        results[0] = (omp_get_wtime() - start) * 1000.0;
+
+        start = omp_get_wtime();
+        if (filter_region_spatial(spatial, width, height, line_length, 0, 0, width, height,
+                                  param_radius_max_diviser, -1, NULL) == 0) {
+            results[1] = (omp_get_wtime() - start) * 1000.0;
+            results[2] = luma_ssim(full, spatial, width, height, line_length);
+            psnr = luma_psnr(full, spatial, width, height, line_length);
+        }
+    }
+
+    release_unselected_engines();
+    free(full);
+    free(spatial);
+    return psnr;
+}
+
+/**
+ * Compare le moteur complet décimé d'un facteur donné au moteur complet en pleine
+ * résolution, sur une copie de l'image (le framebuffer n'est pas modifié ; les
+ * ressources du moteur non sélectionné sont libérées)
+ * @param factor Facteur de décimation (2 à MOIRE_DECIMATION_MAX)
+ * @param results Sortie : durées pleine résolution et décimée (ms), puis leur mémoire
+ *        de travail (octets, masques compris), puis 1 si la transformée réduite est
+ *        sautée car le filtre ne modifie aucune fréquence réduite (0 sinon), soit 5 valeurs
+ * @return PSNR (dB) de la sortie décimée par rapport à la pleine résolution, -1 en cas
+ *         d'erreur ou de facteur invalide
+ */
+EXPORT double compare_moire_decimation(const unsigned char *fb_data, int width, int height, int line_length,
+                                       float param_radius_min, float param_radius_max_diviser, int factor,
+                                       double *results) {
+    size_t size = (size_t)line_length * height;
+    unsigned char *full;
+    unsigned char *decimated;
+    double psnr = -1.0;
+
+    if (factor < 2 || factor > MOIRE_DECIMATION_MAX) {
+        return -1.0;
+    }
+
+    full = malloc(size);
+    decimated = malloc(size);
+    if (!full || !decimated) {
+        free(full);
+        free(decimated);
+        return -1.0;
+    }
+    memcpy(full, fb_data, size);
+    memcpy(decimated, fb_data, size);
+
+    // Premier passage hors mesure : plans et masques
+    if (init_fftw_resources(width, height, line_length, g_pad_mode) == 0 &&
+        filter_window(&g_screen->full, full, line_length, width, height, 0, 0, width, height,
+                      param_radius_min, param_radius_max_diviser, -1, NULL, NULL) == 0 &&
+        filter_region_decimated(decimated, width, height, line_length, 0, 0, width, height, 0, factor,
+                                param_radius_min, param_radius_max_diviser, -1, NULL) == 0) {
+        memcpy(full, fb_data, size);
+        memcpy(decimated, fb_data, size);
+
+        double start = omp_get_wtime();
+        filter_window(&g_screen->full, full, line_length, width, height, 0, 0, width, height,
+                      param_radius_min, param_radius_max_diviser, -1, NULL, NULL);
+        results[0] = (omp_get_wtime() - start) * 1000.0;
+
+        start = omp_get_wtime();
+        filter_region_decimated(decimated, width, height, line_length, 0, 0, width, height, 0, factor,
+                                param_radius_min, param_radius_max_diviser, -1, NULL);
+        results[1] = (omp_get_wtime() - start) * 1000.0;
+
+        // Sans transformée, la mémoire de travail est le plan décimé
+        int small_w = (width + factor - 1) / factor, small_h = (height + factor - 1) / factor;
+        int skipped = decimated_filter_is_identity(width / factor, height / factor, factor,
+                                                   param_radius_min, param_radius_max_diviser);
+        fftw_resources *res = skipped ? NULL : acquire_rect_resources(small_w, small_h, g_pad_mode);
+        results[2] = (double)(g_screen->full.bytes + g_screen->full.mask.bytes);
+        results[3] = skipped ? (double)sizeof(float) * small_w * small_h
+                             : (res ? (double)(res->bytes + res->mask.bytes) : 0.0);
+        results[4] = skipped;
+
+        psnr = luma_psnr(full, decimated, width, height, line_length);
+    }
+
+    release_unselected_engines();
+    free(full);
+    free(decimated);
+    return psnr;
+}
+
+/**
+ * Vérifie que les noyaux de conversion utilisés (NEON si disponible) donnent
+ * exactement le même résultat que les versions scalaires, sur toutes les valeurs
+ * de pixels et des longueurs de ligne qui ne sont pas multiples de 8 (l'interpolation
+ * de la décimation est comparée à l'arrondi flottant près)
+ * @return Nombre de valeurs différentes (0 si équivalents), -1 en cas d'erreur
+ */
+EXPORT int check_moire_kernels() {
+    const int count = 4 * 256 + 5;
+    unsigned char *rgb = malloc(count * 3);
+    unsigned char *rgb_ref = malloc(count * 3);
+    unsigned char *rgb_out = malloc(count * 3);
+    float *luma_ref = malloc(sizeof(float) * count);
+    float *luma_out = malloc(sizeof(float) * count);
+    float *upsampled = malloc(sizeof(float) * count);
+    int mismatches = 0;
+
+    if (!rgb || !rgb_ref || !rgb_out || !luma_ref || !luma_out || !upsampled) {
+        free(rgb); free(rgb_ref); free(rgb_out); free(luma_ref); free(luma_out); free(upsampled);
+        return -1;
+    }
+
+    // Motif couvrant toutes les valeurs de canal, dont les extrêmes 0 et 255
+    for (int i = 0; i < count * 3; i++) {
+        rgb[i] = (unsigned char)((i * 7 + i / 3) & 0xFF);
+    }
+    rgb[0] = rgb[1] = rgb[2] = 255;
+    rgb[3] = rgb[4] = rgb[5] = 0;
+
+    for (int n = count - 7; n <= count; n++) {
+        luma_row_from_rgb24_scalar(rgb, luma_ref, n);
+        luma_row_from_rgb24(rgb, luma_out, n);
+        for (int x = 0; x < n; x++) {
+            mismatches += (luma_ref[x] != luma_out[x]);
+        }
+    }
+
+    // Valeurs hors de [0, 255] après normalisation pour éprouver la saturation
+    for (int x = 0; x < count; x++) {
+        luma_ref[x] = ((float)x - 256.0f) * 1.37f;
+    }
+
+    for (int n = count - 7; n <= count; n++) {
+        rgb24_row_from_luma_scalar(luma_ref, rgb_ref, n, 0.5f);
+        rgb24_row_from_luma(luma_ref, rgb_out, n, 0.5f);
+        mismatches += (memcmp(rgb_ref, rgb_out, n * 3) != 0);
+    }
+
+    // Agrandissement de la décimation (src lu de src - 1 à src + n)
+    for (int factor = 2; factor <= MOIRE_DECIMATION_MAX; factor++) {
+        const float *src = luma_ref + 1;
+        for (int n = (count - 2) / factor - 3; n <= (count - 2) / factor; n++) {
+            upsample_row_scalar(src, luma_out, n, factor);
+            upsample_row(src, upsampled, n, factor);
+            for (int x = 0; x < n * factor; x++) {
+                mismatches += fabsf(upsampled[x] - luma_out[x]) > 1e-3f;
+            }
+        }
+    }
+
+    free(rgb); free(rgb_ref); free(rgb_out); free(luma_ref); free(luma_out); free(upsampled);
+    return mismatches;
+}
+
+/**
+ * Crée un contexte de filtrage de l'écran complet pour une géométrie donnée
+ * (plans FFTW créés avec le bourrage et le mode économe courants)
+ *
+ * Chaque contexte a ses propres plans, buffers, masque et durées : un thread de fond
+ * peut filtrer une page dans son contexte pendant que le thread de l'interface
+ * utilise les fonctions remove_moire... Un même contexte ne doit servir qu'à un appel
+ * à la fois.
+ * @param width Largeur de l'image
+ * @param height Hauteur de l'image
+ * @param line_length Longueur de ligne du framebuffer
+ * @return Contexte à libérer avec moire_ctx_destroy(), NULL en cas d'erreur
+ */
+EXPORT moire_ctx *moire_ctx_create(int width, int height, int line_length) {
+    if (width <= 0 || height <= 0 || line_length < width * 3) {
+        return NULL;
+    }
+
+    moire_ctx *ctx = malloc(sizeof(moire_ctx));
+    if (!ctx) {
+        return NULL;
+    }
+    if (init_moire_ctx(ctx, width, height, line_length, g_pad_mode, NULL) != 0) {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/**
+ * Supprime le moiré d'une image dans un contexte (écran entier, sans empreintes ni cache)
+ * @param ctx Contexte créé pour la géométrie de l'image
+ * @param fb_data Données du framebuffer (RGB24)
+ * @param tolerance Tolérance de détection de couleur (négative : pas de détection)
+ * @param param_radius_min Rayon minimal du filtre
+ * @param param_radius_max_diviser Diviseur du rayon maximal du filtre
+ * @return MOIRE_FILTERED, MOIRE_COLORED (image laissée intacte) ou -1 en cas d'erreur
+ */
+EXPORT int moire_ctx_process(moire_ctx *ctx, unsigned char *fb_data, int tolerance,
+                             float param_radius_min, float param_radius_max_diviser) {
+    if (!ctx || !fb_data) {
+        return -1;
+    }
+
+    int width = ctx->full.image_width;
+    int height = ctx->full.image_height;
+    int rc = filter_window(&ctx->full, fb_data, ctx->line_length, width, height, 0, 0, width, height,
+                           param_radius_min, param_radius_max_diviser, tolerance, NULL, NULL);
+    if (rc < 0) {
+        return -1;
+    }
+    return (rc == 1) ? MOIRE_COLORED : MOIRE_FILTERED;
+}
+
+/**
+ * Durées des étapes du dernier filtrage d'un contexte (même ordre que get_moire_timings)
+ * @param ctx Contexte
+ * @param out_ms Tableau de sortie
+ * @param count Taille du tableau
+ * @return Nombre de valeurs écrites
+ */
+EXPORT int moire_ctx_get_timings(moire_ctx *ctx, double *out_ms, int count) {
+    if (!ctx) {
+        return 0;
+    }
+    int n = (count < MOIRE_STAGE_COUNT) ? count : MOIRE_STAGE_COUNT;
+    for (int i = 0; i < n; i++) {
+        out_ms[i] = ctx->stage_ms[i];
+    }
+    return n;
+}
+
+/**
+ * Libère un contexte et ses ressources FFTW
+ * @param ctx Contexte créé par moire_ctx_create(), NULL accepté
+ */
+EXPORT void moire_ctx_destroy(moire_ctx *ctx) {
+    if (!ctx) {
+        return;
+    }
+    release_fftw_resources(&ctx->full);
+    free(ctx);
+}
+
+/**
+ * Filtre une copie d'écran dans le contexte du thread de fond (appelé hors du verrou)
+ * @return Code de moire_ctx_process()
+ */
+static int process_async_frame(async_frame *job) {
+    moire_ctx *ctx = g_async.ctx;
+    if (ctx && (ctx->full.image_width != job->width || ctx->full.image_height != job->height ||
+                ctx->line_length != job->line_length)) {
+        moire_ctx_destroy(ctx);
+        ctx = NULL;
+    }
+    if (!ctx) {
+        ctx = moire_ctx_create(job->width, job->height, job->line_length);
+    }
+    g_async.ctx = ctx;
+
+    job->source_hash = hash_tile(job->data, job->line_length, 0, 0, job->width, job->height);
+    if (!ctx) {
+        return -1;
+    }
+    int rc = moire_ctx_process(ctx, job->data, job->tolerance, job->radius_min, job->radius_max_diviser);
+    memcpy(job->stage_ms, ctx->stage_ms, sizeof(job->stage_ms));
+    return rc;
+}
+
+/**
+ * Boucle du thread de fond : prend la dernière demande déposée et la filtre
+ * (les demandes asynchrones passent avant le préfiltrage)
+ */
+static void *async_worker_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_async.lock);
+    for (;;) {
+        while (!g_async.quit && !g_async.has_pending && !g_async.has_prefetch) {
+            pthread_cond_wait(&g_async.wake, &g_async.lock);
+        }
+        if (g_async.quit) {
+            break;
+        }
+
+        if (g_async.has_pending) {
+            async_frame swap = g_async.active;
+            g_async.active = g_async.pending;
+            g_async.pending = swap;
+            g_async.has_pending = 0;
+            g_async.cancelled = 0;
+            g_async.busy = 1;
+            pthread_mutex_unlock(&g_async.lock);
+
+            // Le filtrage se fait hors du verrou : une nouvelle demande peut être déposée pendant ce temps
+            int rc = process_async_frame(&g_async.active);
+
+            pthread_mutex_lock(&g_async.lock);
+            g_async.busy = 0;
+            if (!g_async.cancelled && !g_async.has_pending) {
+                g_async.result = rc;
+                g_async.state = ASYNC_DONE;
+            }
+        } else {
+            async_frame swap = g_async.prefetch_work;
+            g_async.prefetch_work = g_async.prefetch_pending;
+            g_async.prefetch_pending = swap;
+            g_async.has_prefetch = 0;
+            g_async.busy = 1;
+            pthread_mutex_unlock(&g_async.lock);
+
+            int rc = process_async_frame(&g_async.prefetch_work);
+
+            pthread_mutex_lock(&g_async.lock);
+            g_async.busy = 0;
+            if (rc >= 0) {
+                swap = g_async.prefetch_ready;
+                g_async.prefetch_ready = g_async.prefetch_work;
+                g_async.prefetch_work = swap;
+                g_async.prefetch_result = rc;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_async.lock);
+    return NULL;
+}
+
+/**
+ * Libère la copie d'écran d'une demande
+ */
+static void release_async_frame(async_frame *frame) {
+    if (frame->data) {
+        account_free(frame->bytes);
+        free(frame->data);
+    }
+    memset(frame, 0, sizeof(*frame));
+}
+
+/**
+ * Arrête le thread de fond (en attendant la fin du filtrage en cours) et libère ses ressources
+ */
+static void stop_async_worker() {
+    if (g_async.started) {
+        pthread_mutex_lock(&g_async.lock);
+        g_async.quit = 1;
+        pthread_cond_signal(&g_async.wake);
+        pthread_mutex_unlock(&g_async.lock);
+        pthread_join(g_async.thread, NULL);
+        g_async.started = 0;
+        g_async.quit = 0;
+    }
+    moire_ctx_destroy(g_async.ctx);
+    g_async.ctx = NULL;
+    release_async_frame(&g_async.pending);
+    release_async_frame(&g_async.active);
+    release_async_frame(&g_async.prefetch_pending);
+    release_async_frame(&g_async.prefetch_work);
+    release_async_frame(&g_async.prefetch_ready);
+    g_async.has_pending = 0;
+    g_async.has_prefetch = 0;
+    g_async.prefetch_result = -1;
+    g_async.cancelled = 0;
+    g_async.state = ASYNC_IDLE;
+}
+
+/**
+ * Lance le thread de fond s'il ne tourne pas encore
+ * @return 0 en cas de succès, -1 en cas d'erreur
+ */
+static int ensure_async_worker() {
+    if (!g_async.started) {
+        if (pthread_create(&g_async.thread, NULL, async_worker_main, NULL) != 0) {
+            return -1;
+        }
+        g_async.started = 1;
+    }
+    return 0;
+}
+
+/**
+ * Redimensionne la copie d'une demande (à appeler sous le verrou)
+ * @return 0 en cas de succès, -1 en cas d'erreur d'allocation
+ */
+static int reserve_async_frame(async_frame *frame, size_t bytes) {
+    if (frame->bytes == bytes) {
+        return 0;
+    }
+    release_async_frame(frame);
+    frame->data = malloc(bytes);
+    if (!frame->data) {
+        return -1;
+    }
+    frame->bytes = bytes;
+    account_alloc(bytes);
+    return 0;
+}
+
+/**
+ * Lance en arrière-plan la suppression du moiré sur l'écran complet et rend la main aussitôt
+ *
+ * L'écran est copié : le framebuffer reste utilisable pendant le filtrage, qui se fait
+ * dans un contexte propre au thread de fond (écran complet, sans empreintes ni mode
+ * incrémental). Une demande précédente encore en cours devient obsolète. Le résultat
+ * est récupéré avec moire_async_poll().
+ * @param tolerance Tolérance de détection de couleur (négative : pas de détection)
+ * @return 0 si la demande est déposée, -1 en cas d'erreur (filtrer alors de façon synchrone)
+ */
+EXPORT int moire_async_start(unsigned char *fb_data, int width, int height, int line_length, int tolerance,
+                             float param_radius_min, float param_radius_max_diviser) {
+    if (!fb_data || width <= 0 || height <= 0 || line_length < width * 3) {
+        return -1;
+    }
+
+    if (ensure_async_worker() != 0) {
+        return -1;
+    }
+
+    // Les brouillons sont refiltrés depuis leur source
+    restore_draft_sources(fb_data, width, height, line_length, 0, 0, width, height);
+
+    size_t bytes = (size_t)line_length * height;
+    pthread_mutex_lock(&g_async.lock);
+    async_frame *job = &g_async.pending;
+    if (reserve_async_frame(job, bytes) != 0) {
+        g_async.has_pending = 0;
+        pthread_mutex_unlock(&g_async.lock);
+        return -1;
+    }
+    memcpy(job->data, fb_data, bytes);
+    job->width = width;
+    job->height = height;
+    job->line_length = line_length;
+    job->tolerance = tolerance;
+    job->radius_min = param_radius_min;
+    job->radius_max_diviser = param_radius_max_diviser;
+
+    g_async.has_pending = 1;
+    g_async.cancelled = 1;
+    g_async.state = ASYNC_RUNNING;
+    pthread_cond_signal(&g_async.wake);
+    pthread_mutex_unlock(&g_async.lock);
+    return 0;
+}
+
+/**
+ * Récupère le résultat du dernier filtrage asynchrone, sans attendre
+ *
+ * Si l'écran est encore celui qui a été copié par moire_async_start(), l'image filtrée
+ * y est recopiée et enregistrée comme dernière image produite. À appeler depuis le
+ * thread qui utilise le framebuffer.
+ * @return MOIRE_PENDING (pas encore prêt), MOIRE_FILTERED (framebuffer mis à jour),
+ *         MOIRE_COLORED (image en couleur, framebuffer intact), MOIRE_STALE (l'écran a
+ *         changé depuis la demande, framebuffer intact) ou -1 (aucune demande, ou erreur)
+ */
+EXPORT int moire_async_poll(unsigned char *fb_data, int width, int height, int line_length) {
+    pthread_mutex_lock(&g_async.lock);
+    int state = g_async.state;
+    if (state == ASYNC_DONE) {
+        g_async.state = ASYNC_IDLE;
+    }
+    pthread_mutex_unlock(&g_async.lock);
+
+    if (state == ASYNC_RUNNING) {
+        return MOIRE_PENDING;
+    }
+    if (state != ASYNC_DONE) {
+        return -1;
+    }
+
+    // Le thread de fond n'écrit plus dans active avant la prochaine demande, déposée par ce même thread
+    async_frame *job = &g_async.active;
+    if (g_async.result < 0) {
+        return -1;
+    }
+    if (job->width != width || job->height != height || job->line_length != line_length ||
+        hash_tile(fb_data, line_length, 0, 0, width, height) != job->source_hash) {
+        return MOIRE_STALE;
+    }
+
+    // L'écran ne vient plus du cache du mode incrémental, qui décrit l'image précédente
+    g_cache.gray_frame = 0;
+    if (g_async.result == 1) {
+        return MOIRE_COLORED;
+    }
+
+    for (int y = 0; y < height; y++) {
+        memcpy(&fb_data[y * line_length], &job->data[y * line_length], width * 3);
+    }
+    memcpy(g_stage_ms, job->stage_ms, sizeof(g_stage_ms));
+    record_frame(fb_data, width, height, line_length);
+    return MOIRE_FILTERED;
+}
+
+/**
+ * Lance en arrière-plan la suppression du moiré sur une image hors écran (par exemple la
+ * page suivante, rendue dans une BlitBuffer) pour l'afficher sans attendre plus tard
+ *
+ * L'image est copiée en RGB24 ; le résultat est identifié par l'empreinte de cette
+ * copie, et moire_prefilter_apply() ne l'utilise que si l'écran lui est identique. Une
+ * nouvelle demande remplace celle qui n'a pas encore commencé ; le dernier résultat
+ * terminé est conservé jusqu'au suivant.
+ * @param data Premier pixel de l'image
+ * @param stride Longueur de ligne de l'image, en octets
+ * @param bytes_per_pixel 3 (RGB24) ou 1 (niveaux de gris 8 bits, répétés sur les 3 canaux)
+ * @param tolerance Tolérance de détection de couleur (négative : pas de détection)
+ * @return 0 si la demande est déposée, -1 en cas d'erreur
+ */
+EXPORT int moire_prefilter_start(const unsigned char *data, int width, int height, int stride,
+                                 int bytes_per_pixel, int tolerance,
+                                 float param_radius_min, float param_radius_max_diviser) {
+    if (!data || width <= 0 || height <= 0 || (bytes_per_pixel != 1 && bytes_per_pixel != 3) ||
+        stride < width * bytes_per_pixel) {
+        return -1;
+    }
+    if (ensure_async_worker() != 0) {
+        return -1;
+    }
+
+    const int line_length = width * 3;
+    pthread_mutex_lock(&g_async.lock);
+    async_frame *job = &g_async.prefetch_pending;
+    if (reserve_async_frame(job, (size_t)line_length * height) != 0) {
+        g_async.has_prefetch = 0;
+        pthread_mutex_unlock(&g_async.lock);
+        return -1;
+    }
+    for (int y = 0; y < height; y++) {
+        const unsigned char *src = &data[(size_t)y * stride];
+        unsigned char *dst = &job->data[(size_t)y * line_length];
+        if (bytes_per_pixel == 3) {
+            memcpy(dst, src, line_length);
+        } else {
+            for (int x = 0; x < width; x++) {
+                dst[3 * x] = dst[3 * x + 1] = dst[3 * x + 2] = src[x];
+            }
+        }
+    }
+    job->width = width;
+    job->height = height;
+    job->line_length = line_length;
+    job->tolerance = tolerance;
+    job->radius_min = param_radius_min;
+    job->radius_max_diviser = param_radius_max_diviser;
+
+    g_async.has_prefetch = 1;
+    pthread_cond_signal(&g_async.wake);
+    pthread_mutex_unlock(&g_async.lock);
+    return 0;
+}
+
+/**
+ * Remplace l'écran par le résultat du préfiltrage s'il a été calculé pour cette image
+ *
+ * Sans résultat prêt, la fonction rend la main sans lire le framebuffer. Un résultat
+ * utilisé est consommé et l'écran enregistré comme dernière image produite.
+ * @return MOIRE_FILTERED (framebuffer remplacé), MOIRE_COLORED (image préfiltrée en
+ *         couleur, framebuffer intact) ou -1 (aucun résultat pour cette image)
+ */
+EXPORT int moire_prefilter_apply(unsigned char *fb_data, int width, int height, int line_length) {
+    pthread_mutex_lock(&g_async.lock);
+    int available = g_async.prefetch_result >= 0;
+    pthread_mutex_unlock(&g_async.lock);
+    if (!available) {
+        return -1;
+    }
+    restore_draft_sources(fb_data, width, height, line_length, 0, 0, width, height);
+
+    pthread_mutex_lock(&g_async.lock);
+    async_frame *ready = &g_async.prefetch_ready;
+    int rc = g_async.prefetch_result;
+    if (rc < 0 || ready->width != width || ready->height != height ||
+        hash_tile(fb_data, line_length, 0, 0, width, height) != ready->source_hash) {
+        pthread_mutex_unlock(&g_async.lock);
+        return -1;
+    }
+
+    if (rc == 0) {
+        for (int y = 0; y < height; y++) {
+            memcpy(&fb_data[y * line_length], &ready->data[y * ready->line_length], width * 3);
+        }
+        memcpy(g_stage_ms, ready->stage_ms, sizeof(g_stage_ms));
+    }
+    g_async.prefetch_result = -1;
+    pthread_mutex_unlock(&g_async.lock);
+
+    // L'écran ne vient plus du cache du mode incrémental, qui décrit l'image précédente
+    g_cache.gray_frame = 0;
+    if (rc == 1) {
+        return MOIRE_COLORED;
+    }
+    record_frame(fb_data, width, height, line_length);
+    return MOIRE_FILTERED;
+}
+
+/**
+ * Abandonne le filtrage asynchrone en cours ou en attente (son résultat ne sera pas livré)
+ */
+EXPORT void moire_async_cancel() {
+    pthread_mutex_lock(&g_async.lock);
+    g_async.has_pending = 0;
+    g_async.cancelled = 1;
+    g_async.state = ASYNC_IDLE;
+    pthread_mutex_unlock(&g_async.lock);
+}
+
+/**
+ * Règle le budget mémoire du cache des pages filtrées (0 : cache désactivé et vidé)
+ * Les pages les moins récemment utilisées sont libérées si le budget diminue.
+ * @param budget_bytes Mémoire maximale des pages conservées (1 octet par pixel)
+ */
+EXPORT void set_moire_page_cache(size_t budget_bytes) {
+    g_pages.budget = budget_bytes;
+    if (budget_bytes == 0) {
+        release_page_cache();
+    } else {
+        evict_pages(0);
+    }
+}
+
+/**
+ * Statistiques du cache des pages, dans l'ordre : pages retrouvées, pages filtrées
+ * faute d'être dans le cache, pages conservées, mémoire utilisée (octets)
+ * @param out Tableau de sortie
+ * @param count Taille du tableau
+ * @return Nombre de valeurs écrites
+ */
+EXPORT int get_moire_page_cache_stats(size_t *out, int count) {
+    size_t entries = 0;
+    for (int i = 0; i < PAGE_CACHE_MAX_ENTRIES; i++) {
+        entries += g_pages.entries[i].last_use != 0;
+    }
+    const size_t stats[4] = { g_pages.hits, g_pages.misses, entries, g_pages.bytes };
+    int n = (count < 4) ? count : 4;
+    for (int i = 0; i < n; i++) {
+        out[i] = stats[i];
+    }
+    return n;
+}
+
+/**
+ * Omission du filtrage des pages sans moiré : avant de filtrer l'écran complet
+ * (remove_moire, remove_moire_if_gray), une sonde mesure l'énergie de la luminance
+ * aux fréquences que le filtre supprime sur quelques tuiles réparties sur l'écran.
+ * Sous le seuil, l'image est laissée telle quelle et la fonction retourne
+ * MOIRE_SKIPPED (MOIRE_COLORED pour une image en couleur avec remove_moire_if_gray).
+ * Les rectangles et le filtrage asynchrone ne sont pas concernés.
+ * @param threshold Amplitude efficace (niveaux de gris) de la composante supprimée en
+ *        dessous de laquelle le filtrage est omis, 0 ou moins : toujours filtrer
+ */
+EXPORT void set_moire_skip_threshold(float threshold) {
+    g_skip_threshold = (threshold > 0.0f) ? threshold : 0.0f;
+}
+
+/**
+ * Score de la sonde sur une image, sans la filtrer (réglage du seuil)
+ * @param fb_data Données du framebuffer
+ * @param width Largeur de l'image
+ * @param height Hauteur de l'image
+ * @param line_length Longueur de ligne du framebuffer
+ * @param param_radius_max_diviser Diviseur pour calculer le rayon maximal
+ * @return Amplitude efficace (niveaux de gris) de la composante que le filtre supprimerait,
+ *         -1 si l'image est trop petite pour être sondée
+ */
+EXPORT double probe_moire_energy(const unsigned char *fb_data, int width, int height, int line_length,
+                                 float param_radius_max_diviser) {
+    return probe_frame_energy(fb_data, width, height, line_length, param_radius_max_diviser);
+}
+
+/**
+ * Résultat de la dernière sonde de l'écran complet, dans l'ordre : score (niveaux de
+ * gris, -1 si aucune sonde), 1 si le filtrage a été omis (0 sinon), seuil courant
+ * @param out Tableau de sortie
+ * @param count Taille du tableau
+ * @return Nombre de valeurs écrites
+ */
+EXPORT int get_moire_probe(double *out, int count) {
+    const double probe[3] = { g_probe_score, g_probe_skipped, g_skip_threshold };
+    int n = (count < 3) ? count : 3;
+    for (int i = 0; i < n; i++) {
+        out[i] = probe[i];
+    }
+    return n;
+}
+
+/**
+ * Durées des étapes du dernier filtrage, en millisecondes, dans l'ordre :
+ * luminance et bourrage, FFT, filtrage du spectre, FFT inverse, écriture, total
+ * @param out_ms Tableau de sortie
+ * @param count Taille du tableau
+ * @return Nombre de valeurs écrites
+ */
+EXPORT int get_moire_timings(double *out_ms, int count) {
+    int n = (count < MOIRE_STAGE_COUNT) ? count : MOIRE_STAGE_COUNT;
+    for (int i = 0; i < n; i++) {
+        out_ms[i] = g_stage_ms[i];
+    }
+    return n;
+}
+
+/**
+ * Mémoire actuellement allouée par la bibliothèque (buffers FFT et masques), en octets
+ */
+EXPORT size_t get_moire_current_bytes() {
+    return g_bytes_current;
+}
+
+/**
+ * Pic de mémoire allouée par la bibliothèque depuis son chargement, en octets
+ */
+EXPORT size_t get_moire_peak_bytes() {
+    return g_bytes_peak;
+}
+
+/**
+ * Choisit le bourrage du plan de luminance avant la FFT
+ * (appliqué aux prochains filtrages, les plans sont recréés si la taille change)
+ * @param pad_mode MOIRE_PAD_NONE, MOIRE_PAD_MIRROR, MOIRE_PAD_REPLICATE ou MOIRE_PAD_ZERO
+ * @return 0 en cas de succès, -1 si le mode est inconnu
+ */
+EXPORT int set_moire_padding(int pad_mode) {
+    if (pad_mode < MOIRE_PAD_NONE || pad_mode > MOIRE_PAD_ZERO) {
+        return -1;
+    }
+    g_pad_mode = pad_mode;
+    return 0;
+}
+
+/**
+ * Libère les gros buffers de travail (et les masques) en conservant les plans FFTW,
+ * les dimensions et la sagesse. Les buffers sont réalloués au prochain filtrage et
+ * les plans exécutés dessus sans nouvelle planification. Le cache des pages est vidé
+ * (son budget est conservé : il se remplit de nouveau au réveil). À appeler avant la
+ * mise en veille ; cleanup_moire_resources() reste réservé à la fermeture.
+ */
+EXPORT void trim_moire_resources() {
+    for (int i = 0; i < SCREEN_CACHE_SIZE; i++) {
+        release_fftw_buffers(&g_screens[i].full);
+    }
+    release_frame_cache();
+    release_tiled_buffers();
+    release_page_cache();
+
+    for (int i = 0; i < RECT_PLAN_CACHE_SIZE; i++) {
+        release_fftw_buffers(&g_rect_plans[i]);
+    }
+
+    // Les buffers du filtrage asynchrone ne sont libérés que s'il n'a rien en cours
+    pthread_mutex_lock(&g_async.lock);
+    if (g_async.state == ASYNC_IDLE && !g_async.busy && !g_async.has_prefetch) {
+        release_async_frame(&g_async.pending);
+        release_async_frame(&g_async.active);
+        release_async_frame(&g_async.prefetch_pending);
+        release_async_frame(&g_async.prefetch_work);
+        release_async_frame(&g_async.prefetch_ready);
+        g_async.prefetch_result = -1;
+        if (g_async.ctx) {
+            release_fftw_buffers(&g_async.ctx->full);
+        }
+    }
+    pthread_mutex_unlock(&g_async.lock);
+}
+
+EXPORT void cleanup_moire_resources() {
+    stop_async_worker();
+    cleanup_fftw_resources();
+    release_page_cache();
+    release_draft_frame();
+    // fftwf_cleanup() oublie la sagesse : sauvegarder ce qui n'a pas encore été écrit
+    save_moire_wisdom();
+    fftwf_cleanup_threads();
+    fftwf_cleanup();
+    g_wisdom_loaded = 0;
+    g_fftw_threads = 0;
+}
@@ -0,0 +1,47 @@
+/**
+ * moire_wisdom_gen.c - Génération hors ligne de la sagesse FFTW de moire_filter_fftw_eco
+ *
+ * À lancer une fois sur la liseuse (la sagesse dépend du processeur et du nombre de
+ * threads) pour mesurer les plans en FFTW_PATIENT. Le premier filtrage après un
+ * démarrage ou une sortie de veille n'a ensuite plus qu'à retrouver ses plans.
+ *
+ * Usage : moire_wisdom_gen <fichier_sagesse> <largeur>x<hauteur> [<largeur>x<hauteur> ...]
+ * Exemple : ./moire_wisdom_gen moire_fftw_wisdom.dat 1264x1680 1680x1264
+ */
+
+#include <stdio.h>
+
+int load_moire_wisdom(const char *path);
+int save_moire_wisdom(void);
+int generate_moire_wisdom(int width, int height);
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage : %s <fichier_sagesse> <largeur>x<hauteur> [...]\n", argv[0]);
+        return 1;
+    }
+
+    // Compléter une sagesse existante plutôt que de repartir de zéro
+    load_moire_wisdom(argv[1]);
+
+    for (int i = 2; i < argc; i++) {
+        int width, height;
+        if (sscanf(argv[i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+            fprintf(stderr, "Taille invalide : %s\n", argv[i]);
+            return 1;
+        }
+
+        printf("Planification FFTW_PATIENT %dx%d...\n", width, height);
+        if (generate_moire_wisdom(width, height) != 0) {
+            fprintf(stderr, "Échec de la planification %dx%d\n", width, height);
+            return 1;
+        }
+    }
+
+    if (save_moire_wisdom() < 0) {
+        fprintf(stderr, "Impossible d'écrire %s\n", argv[1]);
+        return 1;
+    }
+    printf("Sagesse écrite dans %s\n", argv[1]);
+    return 0;
+}